@@ -0,0 +1,145 @@
+// filter_async.cpp - coroutine steps for loading, filtering and saving
+// Decoding, filtering and encoding move to the task scheduler before doing their work, so the
+// caller's thread is never blocked and a filter's own parallel_for runs from a pool thread. Reading
+// and writing files holds no pool thread: the request goes to one I/O thread, which sends what is
+// waiting out in batches through io_uring (or the pread / pwrite fallback) and hands each coroutine
+// back to the pool once its file is done.
+
+// libaries
+#include "filter_async.h"
+#include "filter_internal.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// a file read or write a coroutine waits on
+struct io_operation {
+    io_request request;
+    bool writing;
+    std::coroutine_handle<> waiting;
+
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() {}
+};
+
+// the thread doing every coroutine's file I/O and the operations waiting for it
+struct io_service {
+    std::mutex lock;
+    std::condition_variable wake;
+    std::vector<io_operation*> queue;
+    bool stop = false;
+    std::thread thread;
+
+    io_service();
+    ~io_service();
+};
+
+void io_loop(io_service& service) {
+    while (true) {
+        std::vector<io_operation*> operations;
+        {
+            std::unique_lock<std::mutex> guard(service.lock);
+            service.wake.wait(guard, [&]() { return service.stop || !service.queue.empty(); });
+            if (service.queue.empty()) return;
+            // a queue's worth at a time, the rest go out with the next batch
+            size_t count = std::min<size_t>(service.queue.size(), IO_QUEUE_DEPTH);
+            operations.assign(service.queue.begin(), service.queue.begin() + count);
+            service.queue.erase(service.queue.begin(), service.queue.begin() + count);
+        }
+
+        // reads and writes each go out as one batch
+        std::vector<io_request> reads, writes;
+        for (io_operation* operation : operations) {
+            (operation->writing ? writes : reads).push_back(std::move(operation->request));
+        }
+        if (!reads.empty()) batch_read_files(reads);
+        if (!writes.empty()) batch_write_files(writes);
+        size_t read = 0, written = 0;
+        for (io_operation* operation : operations) {
+            operation->request = std::move(operation->writing ? writes[written++] : reads[read++]);
+        }
+
+        // the operations live in the coroutines' frames, each may be gone once it is resumed
+        for (io_operation* operation : operations) {
+            std::coroutine_handle<> waiting = operation->waiting;
+            scheduler_spawn([waiting]() { waiting.resume(); });
+        }
+    }
+}
+
+io_service::io_service() {
+    thread = std::thread(io_loop, std::ref(*this));
+}
+
+io_service::~io_service() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+// started on first use
+io_service& get_io_service() {
+    static io_service service;
+    return service;
+}
+
+void io_operation::await_suspend(std::coroutine_handle<> handle) {
+    waiting = handle;
+    io_service& service = get_io_service();
+    {
+        std::lock_guard<std::mutex> guard(service.lock);
+        service.queue.push_back(this);
+    }
+    service.wake.notify_one();
+}
+
+async_job<async_image> async_load(string file_path) {
+    io_operation input = {};
+    input.request.path = file_path;
+    input.writing = false;
+    co_await input;
+    io_request& request = input.request;
+    if (request.result != 0) {
+        async_image failed = {};
+        failed.result = 1;
+        co_return failed;
+    }
+    co_return co_await async_load_buffer(std::move(request.data));
+}
+
+async_job<async_image> async_load_buffer(std::vector<BYTE> data) {
+    co_await resume_on_pool();
+    async_image loaded = {};
+    loaded.result = read_bmp_buffer(data.data(), data.size(), loaded.image, loaded.file_header, loaded.info_header);
+    if (loaded.result != 0) {
+        loaded.image.pixels = nullptr;
+    }
+    co_return loaded;
+}
+
+async_job<int> async_filter(async_image& image, int filter_id, int filter_strength, const cancel_token* cancel) {
+    filter_params params;
+    params.strength = filter_strength;
+    params.cancel = cancel;
+    return async_filter(image, filter_id, params);
+}
+
+// params is a copy so it outlives the caller's, the token it points at must not
+async_job<int> async_filter(async_image& image, int filter_id, filter_params params) {
+    co_await resume_on_pool();
+    co_return apply_filter(image.image, filter_id, params);
+}
+
+async_job<int> async_save(const async_image& image, string file_path) {
+    co_await resume_on_pool();
+    io_operation output = {};
+    output.request.path = file_path;
+    output.writing = true;
+    encode_bmp_buffer(image.image, image.file_header, image.info_header, output.request.data);
+    co_await output;
+    co_return output.request.result == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+// filter_async.h - coroutine interface to the BMP Image Filtering Library
+// Loading, filtering and saving as C++20 coroutines. Files are read and written by one I/O thread and
+// the work on the pixels hops onto the task scheduler, so a service can have thousands of jobs in
+// flight on a handful of threads and no thread blocks per job.
+//
+//     async_job<int> thumbnail(string in, string out) {
+//         async_image image = co_await async_load(in);
+//         if (image.result != 0) co_return image.result;
+//         co_await async_filter(image, FILTER_GAUSSIAN_BLUR, 3);
+//         int result = co_await async_save(image, out);
+//         freeImage(image.image);
+//         co_return result;
+//     }
+//
+//     spawn_job(thumbnail("a.bmp", "b.bmp"), [](int result) { ... });   // fire and forget
+//     int result = run_job(thumbnail("a.bmp", "b.bmp"));                // block until done
+
+#ifndef FILTER_ASYNC_H
+#define FILTER_ASYNC_H
+
+#include "filter_lib.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// an image and the headers it was loaded with
+struct async_image {
+    ImageDetails image;
+    BitmapFileHeader file_header;
+    BitmapInfoHeader info_header;
+    int result;   // 0 once loaded, as check_and_read_file otherwise
+};
+
+// a coroutine producing a T, it starts when awaited (or passed to run_job / spawn_job)
+template <typename T>
+class async_job {
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+
+        // hand control back to whoever awaited the job once it finishes
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                std::coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+
+        async_job get_return_object() { return async_job(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void return_value(T result) { value = std::move(result); }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    async_job(async_job&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    async_job(const async_job&) = delete;
+    async_job& operator=(const async_job&) = delete;
+    ~async_job() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+        handle.promise().continuation = awaiter;
+        return handle;
+    }
+    T await_resume() {
+        if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+        return std::move(*handle.promise().value);
+    }
+
+private:
+    explicit async_job(std::coroutine_handle<promise_type> job) : handle(job) {}
+    std::coroutine_handle<promise_type> handle;
+};
+
+// a coroutine that starts straight away and frees itself when it finishes
+struct detached_job {
+    struct promise_type {
+        detached_job get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// co_await resume_on_pool() continues the coroutine on a scheduler thread
+struct resume_on_pool {
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        scheduler_spawn([handle]() { handle.resume(); });
+    }
+    void await_resume() {}
+};
+
+// coroutine steps (filter_async.cpp)
+async_job<async_image> async_load(string file_path);
+async_job<async_image> async_load_buffer(std::vector<BYTE> data);
+async_job<int> async_filter(async_image& image, int filter_id, int filter_strength, const cancel_token* cancel = nullptr);
+async_job<int> async_filter(async_image& image, int filter_id, filter_params params);
+async_job<int> async_save(const async_image& image, string file_path);
+
+// start a job without waiting, on_done gets the result on whichever thread finishes it
+// with no pool threads (FILTER_THREADS=1 or one core) each step runs on the thread that made it
+// ready, the caller's until the first file operation and the I/O thread after that
+template <typename T, typename Callback>
+void spawn_job(async_job<T> job, Callback on_done) {
+    [](async_job<T> job, Callback on_done) -> detached_job {
+        on_done(co_await job);
+    }(std::move(job), std::move(on_done));
+}
+
+// run a job to completion, helping the scheduler while waiting
+template <typename T>
+T run_job(async_job<T> job) {
+    std::atomic<bool> finished{false};
+    std::optional<T> result;
+    std::exception_ptr error;
+    [](async_job<T>& job, std::optional<T>& result, std::exception_ptr& error, std::atomic<bool>& finished) -> detached_job {
+        try {
+            result = co_await job;
+        } catch (...) {
+            error = std::current_exception();
+        }
+        finished = true;
+        scheduler_notify();
+    }(job, result, error, finished);
+    scheduler_drive([&]() { return finished.load(); });
+    if (error) std::rethrow_exception(error);
+    return std::move(*result);
+}
+
+#endif
@@ -0,0 +1,724 @@
+// filter_batch.cpp - file level operations
+// Batched io_uring/pread file I/O for directory mode, in-place editing of mapped files for point
+// filters and copy based passthrough for filters that leave the pixels alone.
+
+// libaries
+#include "filter_lib.h"
+#include "filter_internal.h"
+#include <string.h>
+#include <errno.h>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+
+// minimal io_uring ring, set up with raw syscalls so liburing isn't needed
+struct uring {
+    int fd;
+    unsigned entries;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+
+// stages a file moves through in the ring
+enum io_stage { IO_OPEN, IO_STAT, IO_TRANSFER, IO_CLOSE, IO_DONE };
+
+// per file state while it is in the ring
+struct io_slot {
+    int fd;
+    io_stage stage;
+    size_t done;
+    struct statx stat;
+};
+
+// copy a whole file, sharing extents (reflink) where the filesystem allows it
+bool copy_file_contents(int in_fd, int out_fd, size_t size) {
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+        return true;
+    }
+
+    // copy_file_range keeps the data in the kernel
+    size_t done = 0;
+    while (done < size) {
+        ssize_t copied = copy_file_range(in_fd, NULL, out_fd, NULL, size - done, 0);
+        if (copied <= 0) break;
+        done += copied;
+    }
+    if (done == size) {
+        return true;
+    }
+
+    // older kernels refuse cross filesystem copies, finish with plain reads and writes
+    std::vector<BYTE> buffer(1 << 20);
+    while (done < size) {
+        ssize_t got = pread(in_fd, buffer.data(), std::min(buffer.size(), size - done), done);
+        if (got <= 0) return false;
+        if (pwrite(out_fd, buffer.data(), got, done) != got) return false;
+        done += got;
+    }
+    return true;
+}
+
+// copy the file untouched (reflink where possible) and rewrite the header if the filter needs it
+int passthrough_file(program_states& states, const string& out_file_path) {
+    BitmapFileHeader file_header;
+    BitmapInfoHeader info_header;
+    if (read_bmp_headers(states.file_path, file_header, info_header) != 0) {
+        return 2;
+    }
+
+    int in_fd = open(states.file_path.c_str(), O_RDONLY);
+    struct stat info;
+    if (in_fd < 0 || fstat(in_fd, &info) != 0) {
+        std::cerr << "Error: Could not open file " << states.file_path << std::endl;
+        if (in_fd >= 0) close(in_fd);
+        return 1;
+    }
+    int out_fd = open(out_file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        std::cerr << "Error: Could not open output file " << out_file_path << std::endl;
+        close(in_fd);
+        return 1;
+    }
+
+    bool copied = copy_file_contents(in_fd, out_fd, info.st_size);
+    close(in_fd);
+
+    // rewrite the header over the copy, only its first block stops being shared
+    const filter_info* filter = find_filter(states.selected_filter);
+    if (copied && filter != NULL && filter->apply_header != NULL) {
+        filter->apply_header(info_header);
+        copied = pwrite(out_fd, &info_header, sizeof(info_header), sizeof(file_header)) == (ssize_t)sizeof(info_header);
+    }
+    close(out_fd);
+
+    if (!copied) {
+        std::cerr << "Error: Could not copy " << states.file_path << " to " << out_file_path << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// copy the input to the output path, map it shared and filter the mapped rows
+int apply_in_place(program_states& states, const string& out_file_path) {
+    const filter_info* filter = find_filter(states.selected_filter);
+    if (filter == NULL || !filter->in_place || filter->apply_row == NULL) {
+        return 2;
+    }
+    cancel_token cancel;
+    if (states.timeout_ms > 0) {
+        set_deadline(cancel, states.timeout_ms);
+    }
+    filter_params params;
+    params.strength = states.filter_strength;
+    params.cancel = &cancel;
+    params.priority = states.priority;
+    params.quality = states.quality;
+    params.mix = states.mix;
+    params.mask = states.mask.values.empty() ? NULL : &states.mask;
+
+    int in_fd = open(states.file_path.c_str(), O_RDONLY);
+    if (in_fd < 0) {
+        std::cerr << "Error: Could not open file " << states.file_path << std::endl;
+        return 1;
+    }
+
+    BitmapFileHeader file_header;
+    BitmapInfoHeader info_header;
+    struct stat info;
+    size_t header_size = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+    if (fstat(in_fd, &info) != 0
+        || pread(in_fd, &file_header, sizeof(file_header), 0) != (ssize_t)sizeof(file_header)
+        || pread(in_fd, &info_header, sizeof(info_header), sizeof(file_header)) != (ssize_t)sizeof(info_header)
+        || file_header.bfType != 0x4D42 || info_header.biBitCount != 24 || info_header.biCompression != 0
+        || info_header.biWidth <= 0) {
+        // not something we can edit directly, let the normal path deal with it
+        close(in_fd);
+        return 2;
+    }
+
+    int width = info_header.biWidth;
+    int height = abs(info_header.biHeight);
+    int padding = (4 - (width * 3) % 4) % 4;
+    size_t row_size = (size_t)width * 3 + padding;
+    if (header_size + row_size * height > (size_t)info.st_size) {
+        close(in_fd);
+        return 2;
+    }
+
+    int out_fd = open(out_file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        std::cerr << "Error: Could not open output file " << out_file_path << std::endl;
+        close(in_fd);
+        return 1;
+    }
+    bool copied = copy_file_contents(in_fd, out_fd, info.st_size);
+    close(in_fd);
+    if (!copied) {
+        std::cerr << "Error: Could not copy " << states.file_path << " to " << out_file_path << std::endl;
+        close(out_fd);
+        return 1;
+    }
+
+    BYTE* mapped = static_cast<BYTE*>(mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0));
+    close(out_fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Error: Could not map output file " << out_file_path << std::endl;
+        return 1;
+    }
+
+    // filter the mapped rows in bands across the scheduler
+    cancel_scope scope(&cancel);
+    priority_scope priority(states.priority);
+    int weight = mix_weight(params.mix);
+    parallel_for(0, height, 0, [&](int start, int end) {
+        // with a mix each row is filtered into a buffer and blended back over the mapped source
+        std::vector<Pixeldata> filtered(blends(params) ? width : 0);
+        for (int y = start; y < end; y++) {
+            Pixeldata* row = reinterpret_cast<Pixeldata*>(mapped + header_size + row_size * y);
+            // rows the mix leaves alone are never written
+            mask_coverage coverage = blend_coverage(params, 0, y, width, 1);
+            if (coverage == MASK_EMPTY) {
+                continue;
+            }
+            if (coverage == MASK_FULL) {
+                filter->apply_row(row, width, params);
+                continue;
+            }
+            memcpy(filtered.data(), row, sizeof(Pixeldata) * width);
+            filter->apply_row(filtered.data(), width, params);
+            blend_row(row, filtered.data(), row, width, weight, params.mask == NULL ? NULL : params.mask->values.data() + (size_t)y * width);
+        }
+    });
+
+    munmap(mapped, info.st_size);
+    // don't leave a half filtered file behind
+    if (filter_cancelled()) {
+        std::cerr << "Error: Timed out filtering " << states.file_path << std::endl;
+        unlink(out_file_path.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+bool uring_init(uring& ring, unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring.fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring.fd < 0) {
+        // kernel too old or io_uring disabled
+        return false;
+    }
+
+    // map the submission ring, completion ring and the sqe array
+    ring.entries = params.sq_entries;
+    ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring.sq_ring = mmap(NULL, ring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    ring.cq_ring = mmap(NULL, ring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sq_ring == MAP_FAILED || ring.cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+        if (ring.sq_ring != MAP_FAILED) munmap(ring.sq_ring, ring.sq_ring_size);
+        if (ring.cq_ring != MAP_FAILED) munmap(ring.cq_ring, ring.cq_ring_size);
+        if (sqes != MAP_FAILED) munmap(sqes, ring.sqes_size);
+        close(ring.fd);
+        return false;
+    }
+
+    char* sq = static_cast<char*>(ring.sq_ring);
+    ring.sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring.sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring.sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring.sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring.sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* cq = static_cast<char*>(ring.cq_ring);
+    ring.cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring.cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring.cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void uring_exit(uring& ring) {
+    munmap(ring.sqes, ring.sqes_size);
+    munmap(ring.cq_ring, ring.cq_ring_size);
+    munmap(ring.sq_ring, ring.sq_ring_size);
+    close(ring.fd);
+}
+
+// fill in and publish the sqe for the stage a file is at
+void uring_queue_stage(uring& ring, io_request& request, io_slot& slot, size_t index, bool writing) {
+    unsigned tail = *ring.sq_tail;
+    unsigned sq_index = tail & *ring.sq_mask;
+    io_uring_sqe* sqe = &ring.sqes[sq_index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = index;
+
+    switch (slot.stage) {
+        case IO_OPEN:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(request.path.c_str());
+            sqe->open_flags = writing ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+            sqe->len = 0644;
+            break;
+        case IO_STAT:
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = slot.fd;
+            sqe->addr = reinterpret_cast<uint64_t>("");
+            sqe->statx_flags = AT_EMPTY_PATH;
+            sqe->len = STATX_SIZE;
+            sqe->off = reinterpret_cast<uint64_t>(&slot.stat);
+            break;
+        case IO_TRANSFER:
+            sqe->opcode = writing ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd = slot.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(request.data.data() + slot.done);
+            sqe->len = request.data.size() - slot.done;
+            sqe->off = slot.done;
+            break;
+        default:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = slot.fd;
+            break;
+    }
+
+    ring.sq_array[sq_index] = sq_index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// move a file on to its next stage once a completion arrives
+void uring_advance(io_request& request, io_slot& slot, int res, bool writing) {
+    if (res < 0) {
+        request.result = res;
+        if (slot.stage == IO_CLOSE) {
+            slot.fd = -1;
+        }
+        slot.stage = (slot.stage == IO_OPEN || slot.stage == IO_CLOSE) ? IO_DONE : IO_CLOSE;
+        return;
+    }
+
+    switch (slot.stage) {
+        case IO_OPEN:
+            slot.fd = res;
+            slot.stage = writing ? IO_TRANSFER : IO_STAT;
+            break;
+        case IO_STAT:
+            request.data.resize(slot.stat.stx_size);
+            slot.stage = request.data.empty() ? IO_CLOSE : IO_TRANSFER;
+            break;
+        case IO_TRANSFER:
+            if (res == 0 && writing) {
+                // no progress on a write, finishing here would leave a truncated file
+                request.result = -EIO;
+                slot.stage = IO_CLOSE;
+                break;
+            }
+            slot.done += res;
+            if (res == 0) {
+                // file shrank underneath us
+                request.data.resize(slot.done);
+            }
+            if (slot.done >= request.data.size()) {
+                slot.stage = IO_CLOSE;
+            }
+            break;
+        default:
+            slot.fd = -1;
+            slot.stage = IO_DONE;
+            break;
+    }
+}
+
+// open, size, transfer and close every file with up to a ring's worth in flight
+bool uring_run_files(std::vector<io_request>& requests, bool writing) {
+    uring ring;
+    if (!uring_init(ring, IO_QUEUE_DEPTH)) {
+        return false;
+    }
+
+    std::vector<io_slot> slots(requests.size());
+    size_t next = 0;
+    size_t finished = 0;
+    unsigned in_flight = 0;
+    unsigned to_submit = 0;
+
+    while (finished < requests.size()) {
+        // keep the queue full, each file only has one op in flight at a time
+        while (next < requests.size() && in_flight < ring.entries) {
+            slots[next].fd = -1;
+            slots[next].stage = IO_OPEN;
+            slots[next].done = 0;
+            requests[next].result = 0;
+            uring_queue_stage(ring, requests[next], slots[next], next, writing);
+            next++;
+            in_flight++;
+            to_submit++;
+        }
+
+        int ret = syscall(__NR_io_uring_enter, ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            uring_exit(ring);
+            // the caller redoes every file without the ring, so close the ones it opened
+            // a file whose close is already queued is left to it
+            for (size_t i = 0; i < next; i++) {
+                if (slots[i].fd >= 0 && slots[i].stage != IO_CLOSE) {
+                    close(slots[i].fd);
+                }
+            }
+            return false;
+        }
+        // the kernel can take fewer than we queued, the rest go with the next call
+        to_submit -= ret;
+
+        // reap completions and queue each file's next stage
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+            size_t index = cqe->user_data;
+            uring_advance(requests[index], slots[index], cqe->res, writing);
+            if (slots[index].stage == IO_DONE) {
+                finished++;
+                in_flight--;
+            } else {
+                uring_queue_stage(ring, requests[index], slots[index], index, writing);
+                to_submit++;
+            }
+            head++;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    uring_exit(ring);
+    return true;
+}
+
+bool uring_read_files(std::vector<io_request>& requests) {
+    return uring_run_files(requests, false);
+}
+
+bool uring_write_files(std::vector<io_request>& requests) {
+    return uring_run_files(requests, true);
+}
+
+// run one function per request over a small pool of threads
+template <typename Function>
+void run_io_pool(std::vector<io_request>& requests, Function function) {
+    int num_threads = std::max(4u, std::thread::hardware_concurrency());
+    num_threads = std::min<size_t>(num_threads, requests.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&]() {
+            for (size_t i = next++; i < requests.size(); i = next++) {
+                function(requests[i]);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// read a whole file with blocking pread
+void read_whole_file(io_request& request) {
+    request.result = 0;
+    int fd = open(request.path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        request.result = -errno;
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        request.result = -errno;
+        close(fd);
+        return;
+    }
+    request.data.resize(info.st_size);
+    size_t done = 0;
+    while (done < request.data.size()) {
+        ssize_t got = pread(fd, request.data.data() + done, request.data.size() - done, done);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            request.result = -errno;
+            break;
+        }
+        if (got == 0) {
+            request.data.resize(done);
+            break;
+        }
+        done += got;
+    }
+    close(fd);
+}
+
+// write a whole file with blocking pwrite
+void write_whole_file(io_request& request) {
+    request.result = 0;
+    int fd = open(request.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        request.result = -errno;
+        return;
+    }
+    size_t done = 0;
+    while (done < request.data.size()) {
+        ssize_t put = pwrite(fd, request.data.data() + done, request.data.size() - done, done);
+        if (put < 0 && errno == EINTR) continue;
+        if (put < 0) {
+            request.result = -errno;
+            break;
+        }
+        done += put;
+    }
+    close(fd);
+}
+
+// fallback when io_uring is unavailable, blocking pread on a thread pool
+void pread_read_files(std::vector<io_request>& requests) {
+    run_io_pool(requests, read_whole_file);
+}
+
+void pwrite_write_files(std::vector<io_request>& requests) {
+    run_io_pool(requests, write_whole_file);
+}
+
+// try io_uring first, anything it could not do goes through pread
+void batch_read_files(std::vector<io_request>& requests) {
+    if (!uring_read_files(requests)) {
+        pread_read_files(requests);
+        return;
+    }
+    std::vector<io_request*> failed;
+    for (io_request& request : requests) {
+        if (request.result != 0) failed.push_back(&request);
+    }
+    if (!failed.empty()) {
+        std::vector<io_request> retry(failed.size());
+        for (size_t i = 0; i < failed.size(); i++) retry[i].path = failed[i]->path;
+        pread_read_files(retry);
+        for (size_t i = 0; i < failed.size(); i++) *failed[i] = std::move(retry[i]);
+    }
+}
+
+void batch_write_files(std::vector<io_request>& requests) {
+    if (!uring_write_files(requests)) {
+        pwrite_write_files(requests);
+        return;
+    }
+    std::vector<io_request*> failed;
+    for (io_request& request : requests) {
+        if (request.result != 0) failed.push_back(&request);
+    }
+    if (!failed.empty()) {
+        std::vector<io_request> retry(failed.size());
+        for (size_t i = 0; i < failed.size(); i++) {
+            retry[i].path = failed[i]->path;
+            retry[i].data = std::move(failed[i]->data);
+        }
+        pwrite_write_files(retry);
+        for (size_t i = 0; i < failed.size(); i++) *failed[i] = std::move(retry[i]);
+    }
+}
+
+// the bmps in a directory, leaving out the outputs of an earlier run of the filter so a rerun
+// doesn't filter them again
+void list_directory_inputs(const string& directory, const filter_info* filter, std::vector<string>& paths) {
+    string output_suffix = "_" + filter->name;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        string stem = entry.path().stem().string();
+        if (entry.is_regular_file() && entry.path().extension() == ".bmp"
+            && !(stem.size() >= output_suffix.size() && stem.compare(stem.size() - output_suffix.size(), output_suffix.size(), output_suffix) == 0)) {
+            paths.push_back(entry.path().string());
+        }
+    }
+}
+
+// filter every bmp in a directory, reading and writing a queue's worth at a time
+void run_directory_mode(program_states& states, const string& directory) {
+    const filter_info* filter = find_filter(states.selected_filter);
+    std::vector<string> paths;
+    list_directory_inputs(directory, filter, paths);
+    std::sort(paths.begin(), paths.end());
+    if (paths.empty()) {
+        std::cerr << "Error: No BMP files found in " << directory << std::endl;
+        return;
+    }
+
+    size_t written = 0;
+
+    // header only filters are a copy of each file, point filters go straight through a shared mapping of each output,
+    // a mix with the source decodes the pixels like any other filter
+    bool header_only = filter->kind == FILTER_HEADER_ONLY && states.mix == 100 && states.mask_path.empty();
+
+    // separate processes, so a file that crashes or hangs a worker only loses that file
+    if (states.workers > 0 && !header_only) {
+        worker_pool pool;
+        if (start_worker_pool(pool, states.workers, states.timeout_ms, states.overlay) != 0) {
+            return;
+        }
+        std::vector<worker_job> jobs(paths.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            string filename = strip_extension(get_filename(paths[i]));
+            jobs[i] = {paths[i], directory + "/" + filename + "_" + filter->name + ".bmp", states.selected_filter, states.filter_strength, states.priority, states.quality, states.mix, states.timeout_ms, 0};
+        }
+        run_worker_jobs(pool, jobs);
+        stop_worker_pool(pool);
+        for (const worker_job& job : jobs) {
+            if (job.result == 0) {
+                written++;
+            } else if (job.result == 1) {
+                std::cerr << "Error: Invalid file " << job.in_path << std::endl;
+            } else if (job.result == 2) {
+                std::cerr << "Error: Timed out filtering " << job.in_path << std::endl;
+            }
+        }
+        std::cout << "Filtered " << written << " of " << paths.size() << " images in " << directory << std::endl;
+        return;
+    }
+
+    size_t total = paths.size();
+    if (header_only || (states.in_place && filter->in_place)) {
+        std::vector<string> decode;
+        for (const string& path : paths) {
+            program_states job = states;
+            job.file_path = path;
+            string filename = strip_extension(get_filename(path));
+            string out_file_path = directory + "/" + filename + "_" + filter->name + ".bmp";
+            int result = header_only ? passthrough_file(job, out_file_path) : apply_in_place(job, out_file_path);
+            if (result == 0) {
+                written++;
+            } else if (result == 2) {
+                // not a plain 24 bit bmp, a palettised one is still decoded with the rest
+                decode.push_back(path);
+            }
+        }
+        paths.swap(decode);
+    }
+
+    for (size_t start = 0; start < paths.size(); start += IO_QUEUE_DEPTH) {
+        size_t count = std::min<size_t>(IO_QUEUE_DEPTH, paths.size() - start);
+
+        std::vector<io_request> reads(count);
+        for (size_t i = 0; i < count; i++) {
+            reads[i].path = paths[start + i];
+        }
+        batch_read_files(reads);
+
+        // work per image from its size and the filter's cost, biggest first so they don't finish last
+        std::vector<float> work(count, 0);
+        std::vector<int> order(count);
+        float total_work = 0;
+        for (size_t i = 0; i < count; i++) {
+            order[i] = i;
+            BitmapInfoHeader info_header;
+            if (reads[i].result == 0 && reads[i].data.size() >= sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader)) {
+                memcpy(&info_header, reads[i].data.data() + sizeof(BitmapFileHeader), sizeof(info_header));
+                work[i] = (float)std::abs(info_header.biWidth) * std::abs(info_header.biHeight) * filter->cost(states.filter_strength);
+                total_work += work[i];
+            }
+        }
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return work[a] > work[b]; });
+
+        // decode, filter and encode, one task per image
+        // an image is only split into bands if it is big enough for the bands to be worth it and
+        // it would otherwise hold up the batch, the rest run whole so small images fill every core
+        int threads = scheduler_threads();
+        std::vector<io_request> writes(count);
+        priority_scope priority(states.priority);
+        parallel_for(0, count, 1, [&](int first, int last) {
+            for (int k = first; k < last; k++) {
+                int i = order[k];
+                if (reads[i].result != 0) {
+                    std::cerr << "Error: Could not read file " << reads[i].path << ": " << strerror(-reads[i].result) << std::endl;
+                    continue;
+                }
+                ImageDetails image;
+                BitmapFileHeader file_header;
+                BitmapInfoHeader info_header;
+                if (read_bmp_buffer(reads[i].data.data(), reads[i].data.size(), image, file_header, info_header) != 0) {
+                    std::cerr << "Error: Invalid file " << reads[i].path << std::endl;
+                    continue;
+                }
+                std::vector<BYTE>().swap(reads[i].data);
+
+                program_states job = states;
+                job.file_path = reads[i].path;
+                // each image gets its own deadline so one slow image doesn't sink the rest
+                cancel_token cancel;
+                if (job.timeout_ms > 0) {
+                    set_deadline(cancel, job.timeout_ms);
+                }
+                filter_params params;
+                params.strength = job.filter_strength;
+                params.cancel = &cancel;
+                params.priority = job.priority;
+                params.quality = job.quality;
+                params.mix = job.mix;
+                params.overlay = job.overlay;
+                params.top_down = info_header.biHeight < 0;
+                bool split = work[i] >= MIN_SPLIT_WORK && ((int)count < threads || work[i] * threads >= total_work);
+                int result;
+                if (split) {
+                    result = apply_filter(image, job.selected_filter, params);
+                } else {
+                    serial_scope serial;
+                    result = apply_filter(image, job.selected_filter, params);
+                }
+                if (result == 1) {
+                    std::cerr << "Error: Could not filter " << job.file_path << ", the mask doesn't match the image or memory ran out" << std::endl;
+                } else if (result == 2) {
+                    std::cerr << "Error: Timed out filtering " << job.file_path << std::endl;
+                }
+                if (result != 0) {
+                    freeImage(image);
+                    continue;
+                }
+
+                string filename = strip_extension(get_filename(job.file_path));
+                writes[i].path = directory + "/" + filename + "_" + filter->name + ".bmp";
+                encode_filter_output(filter, image, file_header, info_header, writes[i].data);
+                freeImage(image);
+            }
+        });
+
+        // only write the images that made it through
+        writes.erase(std::remove_if(writes.begin(), writes.end(), [](const io_request& request) {
+            return request.path.empty();
+        }), writes.end());
+        batch_write_files(writes);
+        for (const io_request& request : writes) {
+            if (request.result != 0) {
+                std::cerr << "Error: Could not write output file " << request.path << ": " << strerror(-request.result) << std::endl;
+            } else {
+                written++;
+            }
+        }
+    }
+
+    std::cout << "Filtered " << written << " of " << total << " images in " << directory << std::endl;
+}
@@ -0,0 +1,182 @@
+// filter_c.cpp - C interface to the BMP Image Filtering Library
+// Thin wrappers over filter_lib.h, no exceptions cross the boundary.
+
+// libaries
+#include "filter_c.h"
+#include "filter_lib.h"
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+
+struct filter_image {
+    ImageDetails image;
+    BitmapFileHeader file_header;
+    BitmapInfoHeader info_header;
+};
+
+struct filter_cancel {
+    cancel_token token;
+};
+
+int filter_api_version(void) {
+    return FILTER_API_VERSION;
+}
+
+filter_image* filter_load(const unsigned char* data, size_t size) {
+    filter_image* handle = new (std::nothrow) filter_image;
+    if (handle == NULL) return NULL;
+    try {
+        if (read_bmp_buffer(data, size, handle->image, handle->file_header, handle->info_header) != 0) {
+            delete handle;
+            return NULL;
+        }
+    } catch (...) {
+        delete handle;
+        return NULL;
+    }
+    return handle;
+}
+
+filter_image* filter_load_file(const char* path) {
+    if (path == NULL) return NULL;
+    filter_image* handle = new (std::nothrow) filter_image;
+    if (handle == NULL) return NULL;
+    try {
+        // only real bmps, no conversion through the command line
+        if (read_bmp_headers(path, handle->file_header, handle->info_header) != 0
+            || check_and_read_file(path, handle->image, handle->file_header, handle->info_header) != 0) {
+            delete handle;
+            return NULL;
+        }
+    } catch (...) {
+        delete handle;
+        return NULL;
+    }
+    return handle;
+}
+
+filter_image* filter_from_pixels(const unsigned char* bgr, int width, int height, size_t stride) {
+    if (bgr == NULL || stride < (size_t)width * 3) return NULL;
+    filter_image* handle = new (std::nothrow) filter_image;
+    if (handle == NULL) return NULL;
+    try {
+        if (create_image(handle->image, width, height) != 0) {
+            delete handle;
+            return NULL;
+        }
+        for (int y = 0; y < height; y++) {
+            memcpy(handle->image.pixels[y], bgr + stride * y, (size_t)width * 3);
+        }
+        make_bmp_headers(handle->image, handle->file_header, handle->info_header);
+    } catch (...) {
+        freeImage(handle->image);
+        delete handle;
+        return NULL;
+    }
+    return handle;
+}
+
+int filter_width(const filter_image* image) {
+    return image == NULL ? 0 : image->image.width;
+}
+
+int filter_height(const filter_image* image) {
+    return image == NULL ? 0 : image->image.height;
+}
+
+int filter_copy_pixels(const filter_image* image, unsigned char* bgr, size_t stride) {
+    if (image == NULL || bgr == NULL || stride < (size_t)image->image.width * 3) return 1;
+    for (int y = 0; y < image->image.height; y++) {
+        memcpy(bgr + stride * y, image->image.pixels[y], (size_t)image->image.width * 3);
+    }
+    return 0;
+}
+
+int filter_apply(filter_image* image, int filter_id, int strength) {
+    if (image == NULL) return 1;
+    try {
+        return apply_filter(image->image, filter_id, strength);
+    } catch (...) {
+        return 1;
+    }
+}
+
+filter_cancel* filter_cancel_create(void) {
+    return new (std::nothrow) filter_cancel;
+}
+
+void filter_cancel_request(filter_cancel* cancel) {
+    if (cancel == NULL) return;
+    cancel_job(cancel->token);
+}
+
+void filter_cancel_free(filter_cancel* cancel) {
+    delete cancel;
+}
+
+int filter_apply_cancellable(filter_image* image, int filter_id, int strength, filter_cancel* cancel, int timeout_ms) {
+    if (image == NULL || timeout_ms < 0) return 1;
+    try {
+        // the deadline goes on a token of our own so it doesn't stick to the caller's token
+        cancel_token deadline;
+        if (timeout_ms > 0) {
+            set_deadline(deadline, timeout_ms);
+        }
+        deadline.parent = cancel == NULL ? NULL : &cancel->token;
+        filter_params params;
+        params.strength = strength;
+        params.cancel = &deadline;
+        return apply_filter(image->image, filter_id, params);
+    } catch (...) {
+        return 1;
+    }
+}
+
+int filter_chain(filter_image* image, const int* filter_ids, const int* strengths, int count) {
+    if (image == NULL || (count > 0 && (filter_ids == NULL || strengths == NULL))) return 1;
+    try {
+        return apply_filter_chain(image->image, filter_ids, strengths, count);
+    } catch (...) {
+        return 1;
+    }
+}
+
+int filter_save(const filter_image* image, unsigned char** data, size_t* size) {
+    if (image == NULL || data == NULL || size == NULL) return 1;
+    try {
+        std::vector<BYTE> encoded;
+        encode_bmp_buffer(image->image, image->file_header, image->info_header, encoded);
+        *data = static_cast<unsigned char*>(malloc(encoded.size()));
+        if (*data == NULL) return 1;
+        memcpy(*data, encoded.data(), encoded.size());
+        *size = encoded.size();
+    } catch (...) {
+        return 1;
+    }
+    return 0;
+}
+
+int filter_save_file(const filter_image* image, const char* path) {
+    unsigned char* data;
+    size_t size;
+    if (path == NULL || filter_save(image, &data, &size) != 0) return 1;
+    FILE* out_file = fopen(path, "wb");
+    if (out_file == NULL) {
+        free(data);
+        return 1;
+    }
+    bool written = fwrite(data, 1, size, out_file) == size;
+    written = fclose(out_file) == 0 && written;
+    free(data);
+    return written ? 0 : 1;
+}
+
+void filter_free_buffer(unsigned char* data) {
+    free(data);
+}
+
+void filter_free(filter_image* image) {
+    if (image == NULL) return;
+    freeImage(image->image);
+    delete image;
+}
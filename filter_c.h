@@ -0,0 +1,67 @@
+/* filter_c.h - C interface to the BMP Image Filtering Library
+ * Images are opaque handles so the layout behind them can change without breaking callers.
+ * Functions returning int give 0 on success and non zero on failure. */
+
+#ifndef FILTER_C_H
+#define FILTER_C_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FILTER_API_VERSION 2
+
+#if defined(__GNUC__)
+#define FILTER_API __attribute__((visibility("default")))
+#else
+#define FILTER_API
+#endif
+
+typedef struct filter_image filter_image;
+typedef struct filter_cancel filter_cancel;
+
+/* version of the interface the library was built with */
+FILTER_API int filter_api_version(void);
+
+/* load a 24bit BMP from memory or from a file, NULL if it isn't one */
+FILTER_API filter_image* filter_load(const unsigned char* data, size_t size);
+FILTER_API filter_image* filter_load_file(const char* path);
+
+/* make an image from bottom-up BGR rows, stride is the bytes between rows */
+FILTER_API filter_image* filter_from_pixels(const unsigned char* bgr, int width, int height, size_t stride);
+
+FILTER_API int filter_width(const filter_image* image);
+FILTER_API int filter_height(const filter_image* image);
+
+/* copy the pixels out as bottom-up BGR rows, stride is the bytes between rows */
+FILTER_API int filter_copy_pixels(const filter_image* image, unsigned char* bgr, size_t stride);
+
+/* apply a filter by id (see the filter list in README.md) with a strength of 1 - 100 */
+FILTER_API int filter_apply(filter_image* image, int filter_id, int strength);
+
+/* a token another thread can use to stop a running filter_apply_cancellable */
+FILTER_API filter_cancel* filter_cancel_create(void);
+FILTER_API void filter_cancel_request(filter_cancel* cancel);
+FILTER_API void filter_cancel_free(filter_cancel* cancel);
+
+/* like filter_apply but gives up once cancel is requested or timeout_ms has passed (0 for no limit)
+ * cancel may be NULL, returns 2 when stopped early and the image is left partly filtered */
+FILTER_API int filter_apply_cancellable(filter_image* image, int filter_id, int strength, filter_cancel* cancel, int timeout_ms);
+
+/* apply count filters in order */
+FILTER_API int filter_chain(filter_image* image, const int* filter_ids, const int* strengths, int count);
+
+/* encode as a BMP, the buffer is released with filter_free_buffer */
+FILTER_API int filter_save(const filter_image* image, unsigned char** data, size_t* size);
+FILTER_API int filter_save_file(const filter_image* image, const char* path);
+
+FILTER_API void filter_free_buffer(unsigned char* data);
+FILTER_API void filter_free(filter_image* image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
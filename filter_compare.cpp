@@ -0,0 +1,215 @@
+// filter_compare.cpp - image comparison
+// Error measures between two images of the same size for checking filters against each other:
+// mean squared error and PSNR over all channels, the largest channel difference, SSIM on the luma
+// and an optional heatmap of where they differ. Everything runs in bands of rows on the scheduler.
+// SSIM uses 8x8 windows whose sums come from a summed-area table built per band, so memory stays
+// at a few rows of tables however large the image is.
+
+// libaries
+#include "filter_lib.h"
+#include "filter_internal.h"
+#include <string.h>
+#include <math.h>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+// SSIM window size and stabilising constants for 8 bit values
+const int SSIM_WINDOW = 8;
+const double SSIM_C1 = (0.01 * 255) * (0.01 * 255);
+const double SSIM_C2 = (0.03 * 255) * (0.03 * 255);
+
+// output rows of SSIM windows per band
+const int SSIM_BAND = 16;
+
+// integer luma, close to 0.299 R + 0.587 G + 0.114 B
+inline int luma(const Pixeldata& pixel) {
+    return (77 * pixel.R + 150 * pixel.G + 29 * pixel.B) >> 8;
+}
+
+// black through red and yellow to white as the difference grows
+Pixeldata heat_colour(int difference) {
+    int level = std::min(255 * 3, difference * 12);
+    Pixeldata colour;
+    colour.R = std::min(255, level);
+    colour.G = std::clamp(level - 255, 0, 255);
+    colour.B = std::clamp(level - 510, 0, 255);
+    return colour;
+}
+
+// mean SSIM of the windows whose top row is in [start, end)
+double ssim_band(const ImageDetails& a, const ImageDetails& b, int start, int end) {
+    int rows = end - start + SSIM_WINDOW - 1;
+    int stride = a.width + 1;
+    // sums of a, b, a squared, b squared and a times b over the rectangle above and left of each entry
+    std::vector<long long> sum_a((size_t)(rows + 1) * stride, 0);
+    std::vector<long long> sum_b(sum_a.size(), 0);
+    std::vector<long long> sum_aa(sum_a.size(), 0);
+    std::vector<long long> sum_bb(sum_a.size(), 0);
+    std::vector<long long> sum_ab(sum_a.size(), 0);
+    for (int y = 0; y < rows; y++) {
+        const Pixeldata* row_a = a.pixels[start + y];
+        const Pixeldata* row_b = b.pixels[start + y];
+        long long run_a = 0, run_b = 0, run_aa = 0, run_bb = 0, run_ab = 0;
+        size_t above = (size_t)y * stride;
+        size_t here = above + stride;
+        for (int x = 0; x < a.width; x++) {
+            int value_a = luma(row_a[x]);
+            int value_b = luma(row_b[x]);
+            run_a += value_a;
+            run_b += value_b;
+            run_aa += value_a * value_a;
+            run_bb += value_b * value_b;
+            run_ab += value_a * value_b;
+            sum_a[here + x + 1] = sum_a[above + x + 1] + run_a;
+            sum_b[here + x + 1] = sum_b[above + x + 1] + run_b;
+            sum_aa[here + x + 1] = sum_aa[above + x + 1] + run_aa;
+            sum_bb[here + x + 1] = sum_bb[above + x + 1] + run_bb;
+            sum_ab[here + x + 1] = sum_ab[above + x + 1] + run_ab;
+        }
+    }
+
+    // each window's sums are four lookups
+    const double count = SSIM_WINDOW * SSIM_WINDOW;
+    double total = 0;
+    for (int y = 0; y < end - start; y++) {
+        size_t top = (size_t)y * stride;
+        size_t bottom = (size_t)(y + SSIM_WINDOW) * stride;
+        for (int x = 0; x + SSIM_WINDOW <= a.width; x++) {
+            size_t left = x;
+            size_t right = x + SSIM_WINDOW;
+            auto window = [&](const std::vector<long long>& sum) {
+                return (double)(sum[bottom + right] - sum[bottom + left] - sum[top + right] + sum[top + left]);
+            };
+            double mean_a = window(sum_a) / count;
+            double mean_b = window(sum_b) / count;
+            double variance_a = window(sum_aa) / count - mean_a * mean_a;
+            double variance_b = window(sum_bb) / count - mean_b * mean_b;
+            double covariance = window(sum_ab) / count - mean_a * mean_b;
+            total += ((2 * mean_a * mean_b + SSIM_C1) * (2 * covariance + SSIM_C2))
+                   / ((mean_a * mean_a + mean_b * mean_b + SSIM_C1) * (variance_a + variance_b + SSIM_C2));
+        }
+    }
+    return total;
+}
+
+int compare_images(const ImageDetails& a, const ImageDetails& b, image_comparison& result, ImageDetails* diff_map) {
+    if (a.width != b.width || a.height != b.height || a.width <= 0 || a.height <= 0) {
+        return 1;
+    }
+    if (diff_map != NULL && create_image(*diff_map, a.width, a.height) != 0) {
+        return 1;
+    }
+
+    // squared error and largest difference, bytes at a time so the loop vectorises
+    std::mutex lock;
+    long long squared_error = 0;
+    int max_error = 0;
+    parallel_for(0, a.height, 0, [&](int start, int end) {
+        long long band_error = 0;
+        int band_max = 0;
+        for (int y = start; y < end; y++) {
+            const BYTE* row_a = reinterpret_cast<const BYTE*>(a.pixels[y]);
+            const BYTE* row_b = reinterpret_cast<const BYTE*>(b.pixels[y]);
+            long long row_error = 0;
+            int row_max = 0;
+            for (int i = 0; i < a.width * 3; i++) {
+                int difference = abs(row_a[i] - row_b[i]);
+                row_error += difference * difference;
+                row_max = std::max(row_max, difference);
+            }
+            band_error += row_error;
+            band_max = std::max(band_max, row_max);
+
+            if (diff_map != NULL) {
+                for (int x = 0; x < a.width; x++) {
+                    int difference = std::max({abs(row_a[3 * x] - row_b[3 * x]), abs(row_a[3 * x + 1] - row_b[3 * x + 1]), abs(row_a[3 * x + 2] - row_b[3 * x + 2])});
+                    diff_map->pixels[y][x] = heat_colour(difference);
+                }
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        squared_error += band_error;
+        max_error = std::max(max_error, band_max);
+    });
+
+    result.mse = (double)squared_error / ((double)a.width * a.height * 3);
+    result.psnr = result.mse == 0 ? INFINITY : 10 * log10(255.0 * 255.0 / result.mse);
+    result.max_error = max_error;
+
+    // images smaller than a window are compared as a whole
+    if (a.width < SSIM_WINDOW || a.height < SSIM_WINDOW) {
+        result.ssim = result.mse == 0 ? 1 : 0;
+        return 0;
+    }
+    int windows_down = a.height - SSIM_WINDOW + 1;
+    double ssim_total = 0;
+    parallel_for(0, windows_down, SSIM_BAND, [&](int start, int end) {
+        double band = ssim_band(a, b, start, end);
+        std::lock_guard<std::mutex> guard(lock);
+        ssim_total += band;
+    });
+    result.ssim = ssim_total / ((double)windows_down * (a.width - SSIM_WINDOW + 1));
+    return 0;
+}
+
+// load for comparing, rows in bottom up order whichever way the file stores them
+int load_for_compare(const string& file_path, ImageDetails& image) {
+    BitmapFileHeader file_header;
+    BitmapInfoHeader info_header;
+    if (check_and_read_file(file_path, image, file_header, info_header) != 0) {
+        std::cerr << "Error: Invalid file " << file_path << std::endl;
+        return 1;
+    }
+    if (info_header.biHeight < 0) {
+        std::reverse(image.pixels, image.pixels + image.height);
+    }
+    return 0;
+}
+
+int run_compare_mode(const string& first_path, const string& second_path, const string& diff_path) {
+    ImageDetails first;
+    ImageDetails second;
+    if (load_for_compare(first_path, first) != 0) {
+        return 1;
+    }
+    if (load_for_compare(second_path, second) != 0) {
+        freeImage(first);
+        return 1;
+    }
+
+    image_comparison result;
+    ImageDetails diff_map;
+    int status = compare_images(first, second, result, diff_path.empty() ? NULL : &diff_map);
+    freeImage(first);
+    freeImage(second);
+    if (status != 0) {
+        std::cerr << "Error: Images are different sizes" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "MSE: " << result.mse << std::endl;
+    std::cout << "PSNR: " << result.psnr << " dB" << std::endl;
+    std::cout << "SSIM: " << result.ssim << std::endl;
+    std::cout << "Max error: " << result.max_error << std::endl;
+
+    if (!diff_path.empty()) {
+        BitmapFileHeader file_header;
+        BitmapInfoHeader info_header;
+        make_bmp_headers(diff_map, file_header, info_header);
+        io_request request;
+        request.path = diff_path;
+        encode_bmp_buffer(diff_map, file_header, info_header, request.data);
+        freeImage(diff_map);
+        write_whole_file(request);
+        if (request.result != 0) {
+            std::cerr << "Error: Could not write output file " << diff_path << std::endl;
+            return 1;
+        }
+        std::cout << "Diff map saved to: " << diff_path << std::endl;
+    }
+    // 2 when they differ, like cmp
+    return result.max_error == 0 ? 0 : 2;
+}
@@ -0,0 +1,150 @@
+// filter_dispatch.cpp - choosing how each filter call runs
+// Some filters have more than one algorithm giving the same output, and which is fastest depends on
+// the image and the strength: selecting the median of each window is cheapest for small windows
+// while sliding histograms win once they get big, and the integer separable blur usually beats the
+// float 3x3 kernel. Each call is planned from a cost model whose times per pixel are measured on
+// this host the first time a plan is needed, so the crossovers follow the machine. Calls with too
+// little work to repay spreading them over the scheduler's threads run on the calling thread.
+
+// libaries
+#include "filter_lib.h"
+#include <algorithm>
+#include <functional>
+
+// size of the image the model is measured on, small so calibrating takes a few milliseconds
+const int CALIBRATE_WIDTH = 32;
+const int CALIBRATE_HEIGHT = 16;
+
+// nanoseconds for the fastest of a few runs, the first warms the caches
+double best_time(const std::function<void()>& run) {
+    double best = 0;
+    for (int i = 0; i < 3; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// per pixel time of filtering a fresh copy of the calibration image
+double time_per_pixel(const ImageDetails& source, const std::function<void(ImageDetails&)>& filter) {
+    ImageDetails image;
+    create_image(image, source.width, source.height);
+    double best = best_time([&] {
+        copy_block(source, 0, 0, image, 0, 0, source.width, source.height);
+        filter(image);
+    });
+    freeImage(image);
+    return best / ((double)source.width * source.height);
+}
+
+// samples each median algorithm touches per pixel, the unit its per sample time is in
+float select_samples(int offset) {
+    float window = 2 * offset + 1;
+    return window * window;
+}
+
+float histogram_updates(int offset, int width) {
+    // a column out and a column in per step, and a whole window to start each row
+    float window = 2 * offset + 1;
+    return 2 * window + window * window / width;
+}
+
+// fixed and per unit time from a cost measured at two amounts of the unit
+void fit_line(double cost_a, float units_a, double cost_b, float units_b, float& fixed, float& per_unit) {
+    per_unit = std::max(0.0, (cost_b - cost_a) / (units_b - units_a));
+    fixed = std::max(0.0, cost_a - per_unit * units_a);
+}
+
+dispatch_model calibrate_dispatch() {
+    dispatch_model model;
+    model.threads = scheduler_threads();
+
+    // noise, so the medians and sorts do their typical amount of work
+    ImageDetails source;
+    create_image(source, CALIBRATE_WIDTH, CALIBRATE_HEIGHT);
+    unsigned int seed = 12345;
+    for (int y = 0; y < source.height; y++) {
+        BYTE* row = reinterpret_cast<BYTE*>(source.pixels[y]);
+        for (int x = 0; x < source.width * 3; x++) {
+            seed = seed * 1103515245 + 12345;
+            row[x] = seed >> 24;
+        }
+    }
+
+    {
+        // one thread's time, the plan divides it between threads
+        serial_scope serial;
+        model.unit_ns = time_per_pixel(source, [](ImageDetails& image) { applyGrayscale(image); });
+        model.blur_direct_ns = time_per_pixel(source, [](ImageDetails& image) { applyGaussianBlur(image); });
+        model.blur_separable_ns = time_per_pixel(source, [](ImageDetails& image) { separable_blur(image, false); });
+
+        const int small = 2, large = 3, wide = 6;
+        double select_small = time_per_pixel(source, [&](ImageDetails& image) { applyNoiseReduction(image, 2 * small - 2, QUALITY_EXACT, ALGORITHM_SELECT); });
+        double select_large = time_per_pixel(source, [&](ImageDetails& image) { applyNoiseReduction(image, 2 * large - 2, QUALITY_EXACT, ALGORITHM_SELECT); });
+        fit_line(select_small, select_samples(small), select_large, select_samples(large), model.select_ns, model.select_sample_ns);
+        double histogram_small = time_per_pixel(source, [&](ImageDetails& image) { histogram_median(image, small); });
+        double histogram_wide = time_per_pixel(source, [&](ImageDetails& image) { histogram_median(image, wide); });
+        fit_line(histogram_small, histogram_updates(small, CALIBRATE_WIDTH), histogram_wide, histogram_updates(wide, CALIBRATE_WIDTH), model.histogram_ns, model.histogram_update_ns);
+    }
+
+    model.parallel_ns = 0;
+    freeImage(source);
+    return model;
+}
+
+// the cost of a parallel_for, 0 until it has been measured
+std::atomic<float> measured_parallel_ns{0};
+std::atomic<bool> parallel_measuring{false};
+
+// measured by the first thread to ask, outside any lock or static guard: waiting on the parallel_for
+// can run another task on this thread that plans a filter too, and it gets 0 (split the work)
+// rather than waiting on itself
+float parallel_overhead(int threads) {
+    bool expected = false;
+    if (parallel_measuring.compare_exchange_strong(expected, true)) {
+        // empty tasks, so this is only the cost of handing out work and waiting for it
+        measured_parallel_ns = best_time([&] {
+            parallel_for(0, threads * 4, 1, [](int start, int end) {});
+        });
+    }
+    return measured_parallel_ns;
+}
+
+// measured once per process, on first use
+// the single thread measurements run inside the static's guard, nothing in them waits on other tasks
+dispatch_model get_dispatch_model() {
+    static const dispatch_model serial_model = calibrate_dispatch();
+    dispatch_model model = serial_model;
+    model.parallel_ns = parallel_overhead(model.threads);
+    return model;
+}
+
+filter_plan plan_filter(int filter_id, int width, int height, int strength, filter_quality quality) {
+    dispatch_model model = get_dispatch_model();
+    const filter_info* filter = find_filter(filter_id);
+    double pixels = (double)width * height;
+    filter_plan plan = {ALGORITHM_DIRECT, false, 0};
+    if (filter != NULL) {
+        plan.predicted_ns = pixels * filter->cost(strength) * model.unit_ns;
+    }
+
+    // the fast tier's approximations have only one way to run
+    if (filter_id == FILTER_GAUSSIAN_BLUR && quality != QUALITY_FAST) {
+        bool separable = model.blur_separable_ns < model.blur_direct_ns;
+        plan.algorithm = separable ? ALGORITHM_SEPARABLE : ALGORITHM_DIRECT;
+        plan.predicted_ns = pixels * std::max(1, strength) * std::min(model.blur_separable_ns, model.blur_direct_ns);
+    } else if (filter_id == FILTER_NOISE_REDUCTION && quality != QUALITY_FAST) {
+        int offset = noise_reduction_offset(strength);
+        float select = model.select_ns + model.select_sample_ns * select_samples(offset);
+        float histogram = model.histogram_ns + model.histogram_update_ns * histogram_updates(offset, std::max(1, width));
+        plan.algorithm = histogram < select ? ALGORITHM_HISTOGRAM : ALGORITHM_SELECT;
+        plan.predicted_ns = pixels * std::min(select, histogram);
+    }
+
+    // split over n threads the work takes predicted / n plus the overhead, which only pays off
+    // when predicted > overhead * n / (n - 1), doubled since the empty tasks measured flatter it
+    plan.serial = model.threads <= 1 || plan.predicted_ns < 2 * model.parallel_ns * model.threads / (model.threads - 1);
+    return plan;
+}
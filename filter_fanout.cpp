@@ -0,0 +1,144 @@
+// filter_fanout.cpp - several filters from one decode
+// Every branch reads the same decoded source, which is never written, and the branches run at the
+// same time on the scheduler. Point and row filters filter each row as they copy it into their
+// output, header only filters share the source's rows outright unless mixed with them, and the rest
+// filter their own copy.
+
+// libaries
+#include "filter_lib.h"
+#include "filter_internal.h"
+#include <string.h>
+#include <iostream>
+
+// fill one branch's output from the source
+void filter_branch(const ImageDetails& source, const BitmapInfoHeader& info_header, fan_out_branch& branch, const filter_params& common) {
+    const filter_info* filter = find_filter(branch.filter_id);
+    filter_params params = common;
+    params.strength = branch.strength;
+    branch.info_header = info_header;
+
+    // the pixels don't change, so the source's rows are the output, a mix needs the flipped pixels
+    // to blend so it is filtered like the rest
+    if (filter->kind == FILTER_HEADER_ONLY && !blends(params)) {
+        branch.image = source;
+        branch.shared_rows = true;
+        if (filter->apply_header != NULL) {
+            filter->apply_header(branch.info_header);
+        }
+        branch.result = 0;
+        return;
+    }
+
+    if (create_image(branch.image, source.width, source.height) != 0) {
+        branch.result = 3;
+        return;
+    }
+    size_t row_bytes = (size_t)source.width * sizeof(Pixeldata);
+
+    // each row is filtered while it is still in cache from the copy, and mixed with the source row
+    if (filter->apply_row != NULL) {
+        parallel_for(0, source.height, 0, [&](int start, int end) {
+            for (int y = start; y < end; y++) {
+                memcpy(branch.image.pixels[y], source.pixels[y], row_bytes);
+                mask_coverage coverage = blend_coverage(params, 0, y, source.width, 1);
+                if (coverage == MASK_EMPTY) {
+                    continue;
+                }
+                filter->apply_row(branch.image.pixels[y], source.width, params);
+                if (coverage == MASK_PARTIAL) {
+                    blend_block(branch.image, 0, y, source, branch.image, 0, y, source.width, 1, params);
+                }
+            }
+        });
+        branch.result = filter_cancelled() ? 2 : 0;
+        return;
+    }
+
+    parallel_for(0, source.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            memcpy(branch.image.pixels[y], source.pixels[y], row_bytes);
+        }
+    });
+    branch.result = filter_cancelled() ? 2 : apply_filter(branch.image, branch.filter_id, params);
+}
+
+// 0 when every branch was filtered, 1 for a filter that can't fan out, 2 when any branch failed,
+// each branch's result says why: 2 when cancelled, 3 when out of memory
+int fan_out(const ImageDetails& source, const BitmapInfoHeader& info_header, std::vector<fan_out_branch>& branches, const filter_params& params) {
+    // ascii and the temporal filters have nothing to apply to a single image
+    for (fan_out_branch& branch : branches) {
+        const filter_info* filter = find_filter(branch.filter_id);
+        if (filter == NULL || filter->apply == NULL) {
+            return 1;
+        }
+        branch.image.pixels = NULL;
+        branch.shared_rows = false;
+        branch.result = 1;
+    }
+
+    cancel_scope scope(params.cancel);
+    priority_scope priority(params.priority);
+    parallel_for(0, branches.size(), 1, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            filter_branch(source, info_header, branches[i], params);
+        }
+    });
+
+    for (const fan_out_branch& branch : branches) {
+        if (branch.result != 0) {
+            return 2;
+        }
+    }
+    return 0;
+}
+
+void free_fan_out(std::vector<fan_out_branch>& branches) {
+    for (fan_out_branch& branch : branches) {
+        if (!branch.shared_rows && branch.image.pixels != NULL) {
+            freeImage(branch.image);
+        }
+        branch.image.pixels = NULL;
+    }
+}
+
+// filter the loaded image with every branch and save each as <name>_<filter>.bmp
+int run_fan_out_mode(program_states& states, const ImageDetails& image, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header, std::vector<fan_out_branch>& branches) {
+    cancel_token cancel;
+    if (states.timeout_ms > 0) {
+        set_deadline(cancel, states.timeout_ms);
+    }
+    filter_params params;
+    params.cancel = &cancel;
+    params.priority = states.priority;
+    params.quality = states.quality;
+    params.mix = states.mix;
+    params.mask = states.mask.values.empty() ? NULL : &states.mask;
+    params.overlay = states.overlay;
+    params.top_down = info_header.biHeight < 0;
+
+    if (fan_out(image, info_header, branches, params) == 1) {
+        std::cerr << "Error: Invalid filter type" << std::endl;
+        free_fan_out(branches);
+        return 1;
+    }
+
+    // branches that finished are still saved when another timed out
+    int result = 0;
+    string filename = strip_extension(get_filename(states.file_path));
+    for (const fan_out_branch& branch : branches) {
+        const filter_info* filter = find_filter(branch.filter_id);
+        if (branch.result == 2) {
+            std::cerr << "Error: Timed out filtering " << filter->name << ", no output written" << std::endl;
+            result = 1;
+            continue;
+        }
+        if (branch.result != 0) {
+            std::cerr << "Error: Could not allocate memory for " << filter->name << std::endl;
+            result = 1;
+            continue;
+        }
+        save_filter_output(filter, filename + "_" + filter->name + ".bmp", branch.image, states.file_path, file_header, branch.info_header);
+    }
+    free_fan_out(branches);
+    return result;
+}
@@ -0,0 +1,98 @@
+// filter_internal.h - declarations shared by the library's own files and the filter program
+// Not part of the library's interface, the program's state and the batch, worker and mode code
+// built on it change with the program. None of it is exported from libfilter.so.
+
+#ifndef FILTER_INTERNAL_H
+#define FILTER_INTERNAL_H
+
+// libaries
+#include "filter_lib.h"
+
+// program states struct
+struct program_states {
+    int selected_filter;
+    int filter_strength;
+    string file_path;
+    bool in_place;
+    int timeout_ms;
+    job_priority priority;
+    filter_quality quality;
+    int mix;
+    string mask_path;
+    filter_mask mask;
+    overlay_source* overlay;
+    int workers;
+    bool sequence;
+};
+
+// batch file I/O request
+struct io_request {
+    string path;
+    std::vector<BYTE> data;   // file contents read, or encoded bytes to write
+    int result;               // 0 on success, negative errno on failure
+};
+
+// how many files the batch I/O keeps in flight
+const int IO_QUEUE_DEPTH = 64;
+
+// how long a worker may spend on one image when there is no --timeout-ms, before it is taken to be hung
+const int WORKER_WATCHDOG_MS = 120000;
+
+// a worker process and the supervisor's end of its socket
+struct worker_process {
+    int pid;
+    int socket;
+};
+
+// forked worker processes, see filter_workers.cpp
+struct worker_pool {
+    std::vector<worker_process> workers;
+    int job_timeout_ms;
+    // loaded before the workers fork, so each has it without reading it again
+    const overlay_source* overlay;
+};
+
+// a file to filter in a worker process
+// result is 0 when written, 1 for an unreadable or invalid file, 2 timed out, 3 the worker crashed
+struct worker_job {
+    string in_path;
+    string out_path;
+    int filter_id;
+    int filter_strength;
+    int priority;
+    int quality;
+    int mix;
+    int timeout_ms;
+    int result;
+};
+
+// batch and file level operations (filter_batch.cpp)
+void read_whole_file(io_request& request);
+void write_whole_file(io_request& request);
+bool uring_read_files(std::vector<io_request>& requests);
+bool uring_write_files(std::vector<io_request>& requests);
+void pread_read_files(std::vector<io_request>& requests);
+void pwrite_write_files(std::vector<io_request>& requests);
+void batch_read_files(std::vector<io_request>& requests);
+void batch_write_files(std::vector<io_request>& requests);
+void list_directory_inputs(const string& directory, const filter_info* filter, std::vector<string>& paths);
+void run_directory_mode(program_states& states, const string& directory);
+bool copy_file_contents(int in_fd, int out_fd, size_t size);
+int passthrough_file(program_states& states, const string& out_file_path);
+int apply_in_place(program_states& states, const string& out_file_path);
+
+// frame sequences (filter_sequence.cpp)
+void run_sequence_mode(program_states& states, const string& directory);
+
+// fan out (filter_fanout.cpp)
+int run_fan_out_mode(program_states& states, const ImageDetails& image, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header, std::vector<fan_out_branch>& branches);
+
+// filter pipelines (filter_pipeline.cpp)
+int run_chain_mode(program_states& states, ImageDetails& image, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header, const std::vector<int>& filter_ids, const std::vector<int>& filter_strengths);
+
+// worker processes (filter_workers.cpp)
+int start_worker_pool(worker_pool& pool, int num_workers, int job_timeout_ms, const overlay_source* overlay = NULL);
+void run_worker_jobs(worker_pool& pool, std::vector<worker_job>& jobs);
+void stop_worker_pool(worker_pool& pool);
+
+#endif
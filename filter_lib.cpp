@@ -0,0 +1,1261 @@
+// filter_lib.cpp - BMP Image Filtering Library
+// Reading and writing BMP images and the filters themselves.
+
+// libaries
+#include "filter_lib.h"
+#include "filter_internal.h"
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+// standard deviation for gaussian blur σ ≈ 1
+const float GAUSSIAN_KERNEL[3][3] = {
+    {1.0f/16, 2.0f/16, 1.0f/16},
+    {2.0f/16, 4.0f/16, 2.0f/16},
+    {1.0f/16, 2.0f/16, 1.0f/16}
+};
+
+void ascending_sort(BYTE colour[], int num_elements){
+    for (int i = 0; i < num_elements; i++){
+        for (int j = i + 1; j < num_elements; j++) {
+            // compare elements, smallest on left
+            if (colour[j] < colour[i]){
+                // swqp
+                BYTE temp = colour[i];
+                colour[i] = colour[j];
+                colour[j] = temp;
+            }
+        }
+    }
+}
+
+// Subtract two images pixel-wise
+void subtract_images(const ImageDetails& a, const ImageDetails& b, ImageDetails& result) {
+    // loop through x and y, a - b for each color channel
+    parallel_for(0, a.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            for (int x = 0; x < a.width; x++) {
+                result.pixels[y][x].R = a.pixels[y][x].R - b.pixels[y][x].R;
+                result.pixels[y][x].G = a.pixels[y][x].G - b.pixels[y][x].G;
+                result.pixels[y][x].B = a.pixels[y][x].B - b.pixels[y][x].B;
+            }
+        }
+    });
+}
+
+// Multiply image by scalar
+void multiply_image(ImageDetails& image, float scalar) {
+    // loop through x and y, multipling each color chanel by the scalar clamping between 0 and 255
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            for (int x = 0; x < image.width; x++) {
+                image.pixels[y][x].R = std::clamp(int(image.pixels[y][x].R * scalar), 0, 255);
+                image.pixels[y][x].G = std::clamp(int(image.pixels[y][x].G * scalar), 0, 255);
+                image.pixels[y][x].B = std::clamp(int(image.pixels[y][x].B * scalar), 0, 255);
+            }
+        }
+    });
+}
+
+// Add two images pixel-wise
+void add_images(const ImageDetails& a, const ImageDetails& b, ImageDetails& result) {
+    // loop through x and y, a + b for each color channel
+    parallel_for(0, a.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            for (int x = 0; x < a.width; x++) {
+                result.pixels[y][x].R = std::clamp(int(a.pixels[y][x].R + b.pixels[y][x].R), 0, 255);
+                result.pixels[y][x].G = std::clamp(int(a.pixels[y][x].G + b.pixels[y][x].G), 0, 255);
+                result.pixels[y][x].B = std::clamp(int(a.pixels[y][x].B + b.pixels[y][x].B), 0, 255);
+            }
+        }
+    });
+}
+
+// allocate an image of the given size
+int create_image(ImageDetails& image, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        image.pixels = nullptr;
+        return 1;
+    }
+    image.width = width;
+    image.height = height;
+    image.pixels = new Pixeldata*[height];
+    for (int i = 0; i < height; i++) {
+        image.pixels[i] = new Pixeldata[width];
+    }
+    return 0;
+}
+
+// freeing allocated memory
+void freeImage(ImageDetails& image) {
+    if (image.pixels != nullptr) {
+        for (int i = 0; i < image.height; i++) {
+            delete[] image.pixels[i];
+        }
+        delete[] image.pixels;
+        image.pixels = nullptr;
+    }
+}
+
+bool convert_to_bmp(string filepath){
+    string filename = get_filename(filepath);
+    string outname = replace_ext_with_bmp(filename);
+
+    // Only convert if not already .bmp
+    if (filepath.size() >= 4 && filepath.substr(filepath.size() - 4) == ".bmp") {
+        std::cout << "File is already a BMP: " << filepath << std::endl;
+        return true;
+    }
+
+    // convert to 24 bit bmp using command prompt 
+    string command = "convert \"" + filepath + "\" -depth 8 -type TrueColor BMP3:\"" + outname + "\"";
+    int result = system(command.c_str());
+
+    if (result == 0) {
+        std::cout << "Image converted successfully: " << outname << std::endl;
+        return true;
+    } else {
+        // error message
+        std::cerr << "Image conversion failed with code: " << result << std::endl;
+        return false;
+    }
+}
+
+string get_filename(const string& filepath) {
+    // extract results sfter the last /
+    size_t last_slash = filepath.find_last_of("/\\");
+    if (last_slash == string::npos) return filepath;
+    return filepath.substr(last_slash + 1);
+}
+
+string replace_ext_with_bmp(const string& filename) {
+    // replace the extentions with .bmp
+    size_t last_dot = filename.find_last_of('.');
+    if (last_dot == string::npos) return filename + ".bmp";
+    return filename.substr(0, last_dot) + ".bmp";
+}
+
+Pixeldata** copy_pixels(Pixeldata** source, int height, int width) {
+    // allocate memory for height
+    Pixeldata** destination = new Pixeldata*[height];
+    // every row must exist to be freed later, so this copy is never cancelled
+    cancel_scope scope(nullptr);
+    // loop through y allocating memory for x
+    parallel_for(0, height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            destination[y] = new Pixeldata[width];
+            for (int x = 0; x < width; x++) {
+                // copy the pixel data
+                destination[y][x] = source[y][x];
+            }
+        }
+    });
+    // return copied pixels 
+    return destination;
+}
+
+// checks and reads file
+int check_and_read_file(string file_path, ImageDetails& image, BitmapFileHeader& file_header, BitmapInfoHeader& info_header) {
+    
+    const char* in_file_name = file_path.c_str();
+
+    // open the file in read bytes mode
+    FILE* in_file = fopen(in_file_name, "rb");
+    if (in_file == NULL) {
+        std::cerr << "Error: Could not open file " << in_file_name << std::endl;
+        return 1;
+    }
+
+    // read the file header
+    fread(&file_header, sizeof(BitmapFileHeader), 1, in_file);
+
+    // read the info header
+    fread(&info_header, sizeof(BitmapInfoHeader), 1, in_file);
+
+    // palettised bitmaps are expanded to 24 bit as they're read
+    if (file_header.bfType == 0x4D42 && info_header.biBitCount == 8 && info_header.biCompression == 0) {
+        fclose(in_file);
+        io_request request;
+        request.path = file_path;
+        read_whole_file(request);
+        if (request.result != 0) {
+            return 1;
+        }
+        return read_palette_bmp_buffer(request.data.data(), request.data.size(), image, file_header, info_header);
+    }
+
+    // check if the file is a valid 24bit bitmap
+    if (file_header.bfType != 0x4D42 || info_header.biBitCount != 24 || info_header.biCompression != 0) {
+
+        // debugs
+        // std::cerr << "Error: File is not a valid bitmap" << std::endl;
+        // std::cout << "bfType: " << std::hex << file_header.bfType << std::dec << std::endl;
+        // std::cout << "bfOffBits: " << file_header.bfOffBits << std::endl;
+        // std::cout << "biSize: " << info_header.biSize << std::endl;
+        // std::cout << "biBitCount: " << info_header.biBitCount << std::endl;
+        // std::cout << "biCompression: " << info_header.biCompression << std::endl;
+        fclose(in_file);
+
+        // Only attempt conversion if the file is not already a .bmp
+        if (file_path.size() < 4 || file_path.substr(file_path.size() - 4) != ".bmp") {
+            if (convert_to_bmp(file_path)) {
+                // Try again with the new BMP file
+                string new_bmp = replace_ext_with_bmp(get_filename(file_path));
+                return check_and_read_file(new_bmp, image, file_header, info_header);
+            } else {
+                return 2;
+            }
+        } else {
+            return 2;
+        }
+    }   
+
+    // get the image dimensions
+    image.width = info_header.biWidth;
+    image.height = abs(info_header.biHeight);
+
+    // allocate memory for image
+    image.pixels = new Pixeldata*[image.height];
+    for (int i = 0; i < image.height; i++) {
+        image.pixels[i] = new Pixeldata[image.width];
+    }
+
+    // check if memory allocation was successful
+    if (image.pixels == NULL) {
+        std::cerr << "Error: Could not allocate memory for image" << std::endl;
+        fclose(in_file);
+        return 3;
+    }
+
+    // determine the padding
+    int padding = (4 - (image.width * 3) % 4) % 4;
+
+    // read the pixel data
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            fread(&image.pixels[y][x], sizeof(Pixeldata), 1, in_file);
+        }
+        // skip the padding
+        fseek(in_file, padding, SEEK_CUR);
+    }
+
+    // close the file
+    fclose(in_file);
+    return 0;
+}
+
+// read and check just the headers of a bmp
+int read_bmp_headers(string file_path, BitmapFileHeader& file_header, BitmapInfoHeader& info_header) {
+    FILE* in_file = fopen(file_path.c_str(), "rb");
+    if (in_file == NULL) {
+        std::cerr << "Error: Could not open file " << file_path << std::endl;
+        return 1;
+    }
+    bool complete = fread(&file_header, sizeof(BitmapFileHeader), 1, in_file) == 1
+        && fread(&info_header, sizeof(BitmapInfoHeader), 1, in_file) == 1;
+    fclose(in_file);
+
+    // check if the file is a valid 24bit bitmap
+    if (!complete || file_header.bfType != 0x4D42 || info_header.biBitCount != 24 || info_header.biCompression != 0) {
+        return 2;
+    }
+    return 0;
+}
+
+// file
+void make_output_file(string output_file_name, ImageDetails image,  string file_path, BitmapFileHeader file_header, BitmapInfoHeader info_header) {
+
+    string directory = get_directory(file_path);
+    // make the output file name
+  
+    if (output_file_name.empty()) {
+        output_file_name = get_filename(file_path) + "_out";
+        output_file_name = replace_ext_with_bmp(output_file_name);
+    }
+
+
+    string out_file_path;
+    if (!directory.empty())
+        out_file_path = directory + "/" + output_file_name;
+    else
+        out_file_path = output_file_name;
+
+    std::ofstream out_file(out_file_path, std::ios::binary);
+    
+    if (!out_file) {
+        std::cerr << "Error: Could not open output file " << output_file_name << std::endl;
+        return;
+    } else {
+        out_file.write(reinterpret_cast<char*>(&file_header), sizeof(BitmapFileHeader));
+        out_file.write(reinterpret_cast<char*>(&info_header), sizeof(BitmapInfoHeader));
+        int padding = (4 - (image.width * 3) % 4) % 4;
+        for (int y = 0; y < image.height; y++) {
+            for (int x = 0; x < image.width; x++) {
+                out_file.write(reinterpret_cast<char*>(&image.pixels[y][x]), 3); // BGR format
+            }
+            BYTE pad[3] = {0, 0, 0};
+            out_file.write(reinterpret_cast<char*>(pad), padding);
+        }
+
+        out_file.close();
+        std::cout << "Output file created: " << output_file_name << std::endl;
+    }
+}
+
+// decode a bmp that is already in memory, same checks as check_and_read_file
+int read_bmp_buffer(const BYTE* data, size_t size, ImageDetails& image, BitmapFileHeader& file_header, BitmapInfoHeader& info_header) {
+    size_t header_size = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+    if (data == NULL || size < header_size) {
+        return 2;
+    }
+    memcpy(&file_header, data, sizeof(BitmapFileHeader));
+    memcpy(&info_header, data + sizeof(BitmapFileHeader), sizeof(BitmapInfoHeader));
+    if (info_header.biBitCount == 8) {
+        return read_palette_bmp_buffer(data, size, image, file_header, info_header);
+    }
+
+    // check if the file is a valid 24bit bitmap
+    if (file_header.bfType != 0x4D42 || info_header.biBitCount != 24 || info_header.biCompression != 0 || info_header.biWidth <= 0) {
+        return 2;
+    }
+
+    image.width = info_header.biWidth;
+    image.height = abs(info_header.biHeight);
+
+    // pixels follow the headers, rows padded to 4 bytes
+    int padding = (4 - (image.width * 3) % 4) % 4;
+    size_t row_size = (size_t)image.width * 3 + padding;
+    if (header_size + row_size * image.height > size) {
+        return 2;
+    }
+
+    image.pixels = new Pixeldata*[image.height];
+    const BYTE* row = data + header_size;
+    for (int y = 0; y < image.height; y++) {
+        image.pixels[y] = new Pixeldata[image.width];
+        memcpy(image.pixels[y], row, (size_t)image.width * 3);
+        row += row_size;
+    }
+    return 0;
+}
+
+// the size of an image as an uncompressed 24bit bmp
+size_t bmp_buffer_size(const ImageDetails& image) {
+    int padding = (4 - (image.width * 3) % 4) % 4;
+    return sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader) + ((size_t)image.width * 3 + padding) * image.height;
+}
+
+// encode an image into bmp_buffer_size bytes at data, the same bytes make_output_file would write
+void encode_bmp_into(const ImageDetails& image, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header, BYTE* data) {
+    int padding = (4 - (image.width * 3) % 4) % 4;
+    size_t row_size = (size_t)image.width * 3 + padding;
+
+    memcpy(data, &file_header, sizeof(BitmapFileHeader));
+    memcpy(data + sizeof(BitmapFileHeader), &info_header, sizeof(BitmapInfoHeader));
+    BYTE* row = data + sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+    for (int y = 0; y < image.height; y++) {
+        memcpy(row, image.pixels[y], (size_t)image.width * 3);
+        memset(row + (size_t)image.width * 3, 0, padding);
+        row += row_size;
+    }
+}
+
+void encode_bmp_buffer(const ImageDetails& image, BitmapFileHeader file_header, BitmapInfoHeader info_header, std::vector<BYTE>& data) {
+    data.resize(bmp_buffer_size(image));
+    encode_bmp_into(image, file_header, info_header, data.data());
+}
+
+// save a filter's result next to the input, palettised for the filters that want it
+void save_filter_output(const filter_info* filter, const string& output_file_name, const ImageDetails& image, const string& file_path, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header) {
+    if (filter == NULL || !filter->palettised) {
+        make_output_file(output_file_name, image, file_path, file_header, info_header);
+        return;
+    }
+    string directory = get_directory(file_path);
+    io_request request;
+    request.path = directory.empty() ? output_file_name : directory + "/" + output_file_name;
+    encode_filter_output(filter, image, file_header, info_header, request.data);
+    write_whole_file(request);
+    if (request.result != 0) {
+        std::cerr << "Error: Could not open output file " << output_file_name << std::endl;
+        return;
+    }
+    std::cout << "Output file created: " << output_file_name << std::endl;
+}
+
+// encode a filter's result for saving, 8 bit palettised when the filter leaves few enough colours
+void encode_filter_output(const filter_info* filter, const ImageDetails& image, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header, std::vector<BYTE>& data) {
+    if (filter != NULL && filter->palettised && encode_palette_bmp_buffer(image, info_header, data) == 0) {
+        return;
+    }
+    encode_bmp_buffer(image, file_header, info_header, data);
+}
+
+// headers for a 24bit bitmap of the image's size, for images that didn't come from a file
+void make_bmp_headers(const ImageDetails& image, BitmapFileHeader& file_header, BitmapInfoHeader& info_header) {
+    int padding = (4 - (image.width * 3) % 4) % 4;
+    DWORD image_size = (DWORD)(image.width * 3 + padding) * image.height;
+
+    memset(&file_header, 0, sizeof(file_header));
+    file_header.bfType = 0x4D42;
+    file_header.bfOffBits = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+    file_header.bfSize = file_header.bfOffBits + image_size;
+
+    memset(&info_header, 0, sizeof(info_header));
+    info_header.biSize = sizeof(BitmapInfoHeader);
+    info_header.biWidth = image.width;
+    info_header.biHeight = image.height;
+    info_header.biPlanes = 1;
+    info_header.biBitCount = 24;
+    info_header.biSizeImage = image_size;
+    info_header.biXPelsPerMeter = 2835;
+    info_header.biYPelsPerMeter = 2835;
+}
+
+string get_directory(string file_path) {
+    // get the directory of the file
+    size_t last_slash = file_path.find_last_of("/\\");
+    if (last_slash != string::npos) {
+        return file_path.substr(0, last_slash);
+    }
+    return "";
+}
+
+string strip_extension(string filename) {
+    // remove file extention
+    size_t last_dot = filename.find_last_of('.');
+    if (last_dot == string::npos) return filename;
+    return filename.substr(0, last_dot);
+}
+
+// apply one filter by id, everything but ascii which produces text instead of an image
+int apply_filter(ImageDetails& image, int filter_id, int filter_strength) {
+    filter_params params;
+    params.strength = filter_strength;
+    return apply_filter(image, filter_id, params);
+}
+
+int apply_filter(ImageDetails& image, int filter_id, const filter_params& params) {
+    const filter_info* filter = find_filter(filter_id);
+    if (filter == NULL || filter->apply == NULL) {
+        return 1;
+    }
+    // a mix with the source runs as a pipeline of one, which blends as the filter writes its output
+    if (blends(params)) {
+        filter_pipeline pipeline;
+        build_pipeline(&filter_id, &params.strength, 1, pipeline);
+        return run_pipeline(image, pipeline, params);
+    }
+    cancel_scope scope(params.cancel);
+    priority_scope priority(params.priority);
+    // calls too small to repay spreading out run on this thread
+    if (plan_filter(filter_id, image.width, image.height, params.strength, params.quality).serial) {
+        serial_scope serial;
+        filter->apply(image, params);
+    } else {
+        filter->apply(image, params);
+    }
+    // a cancelled filter leaves the image half done
+    return filter_cancelled() ? 2 : 0;
+}
+
+// apply several filters one after another, scheduled as a pipeline so stencils share a sweep,
+// nothing is applied if any of them is invalid
+int apply_filter_chain(ImageDetails& image, const int filter_ids[], const int filter_strengths[], int count) {
+    filter_pipeline pipeline;
+    if (build_pipeline(filter_ids, filter_strengths, count, pipeline) != 0) {
+        return 1;
+    }
+    return run_pipeline(image, pipeline, filter_params());
+}
+
+void applyGrayscale(ImageDetails& image) {
+    // apply grayscale filter
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            grayscale_row(image.pixels[y], image.width);
+        }
+    });
+}
+
+void grayscale_row(Pixeldata* row, int width) {
+    for (int x = 0; x < width; x++) {
+        int average = (row[x].R + row[x].G + row[x].B) / 3;
+        row[x].R = average;
+        row[x].G = average;
+        row[x].B = average;
+    }
+}
+
+void applySepia(ImageDetails& image, int filter_strength, filter_quality quality) {
+    // apply sepia filter, the strength is how much of the tone replaces the original colours
+    int weight = mix_weight(filter_strength);
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            sepia_row(image.pixels[y], image.width, weight, quality);
+        }
+    });
+}
+
+void sepia_row(Pixeldata* row, int width, int weight, filter_quality quality) {
+    // formula for sepia filter
+    // newRed = 0.393 * R + 0.769 * G + 0.189 * B
+    // newGreen = 0.349 * R + 0.686 * G + 0.168 * B
+    // newBlue = 0.272 * R + 0.534 * G + 0.131 * B
+    // then each blended with the original by weight 256ths
+    int temp_pixels[3];
+    int keep = 256 - weight;
+
+    // the same sums in thousandths, rounding can differ by 1 where the doubles land near a half
+    if (quality != QUALITY_EXACT) {
+        for (int x = 0; x < width; x++) {
+            int red = row[x].R, green = row[x].G, blue = row[x].B;
+            temp_pixels[0] = std::min(255, (393 * red + 769 * green + 189 * blue + 500) / 1000);
+            temp_pixels[1] = std::min(255, (349 * red + 686 * green + 168 * blue + 500) / 1000);
+            temp_pixels[2] = std::min(255, (272 * red + 534 * green + 131 * blue + 500) / 1000);
+            row[x].R = (red * keep + temp_pixels[0] * weight + 128) >> 8;
+            row[x].G = (green * keep + temp_pixels[1] * weight + 128) >> 8;
+            row[x].B = (blue * keep + temp_pixels[2] * weight + 128) >> 8;
+        }
+        return;
+    }
+
+    for (int x = 0; x < width; x++) {
+        temp_pixels[0] = round((row[x].R * 0.393) + (row[x].G * 0.769) + (row[x].B * 0.189));
+        temp_pixels[1] = round((row[x].R * 0.349) + (row[x].G * 0.686) + (row[x].B * 0.168));
+        temp_pixels[2] = round((row[x].R * 0.272) + (row[x].G * 0.534) + (row[x].B * 0.131));
+        // clamp the values to 0-255
+        temp_pixels[0] = std::min(255, temp_pixels[0]);
+        temp_pixels[1] = std::min(255, temp_pixels[1]);
+        temp_pixels[2] = std::min(255, temp_pixels[2]);
+
+        // set the new pixel values, a full weight leaves them as they are
+        row[x].R = (row[x].R * keep + temp_pixels[0] * weight + 128) >> 8;
+        row[x].G = (row[x].G * keep + temp_pixels[1] * weight + 128) >> 8;
+        row[x].B = (row[x].B * keep + temp_pixels[2] * weight + 128) >> 8;
+    }
+}
+
+void applyFlip(ImageDetails& image) {
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            flip_row(image.pixels[y], image.width);
+        }
+    });
+}
+
+void flip_row(Pixeldata* row, int width) {
+    for (int x = 0; x < width / 2; x++) {
+        std::swap(row[x], row[width - x - 1]);
+    }
+}
+
+void applyVerticalFlip(ImageDetails& image) {
+    // rows are separate allocations so swapping the pointers is enough
+    for (int y = 0; y < image.height / 2; y++) {
+        std::swap(image.pixels[y], image.pixels[image.height - y - 1]);
+    }
+}
+
+void applyGaussianBlur(ImageDetails& image) {
+    const int kernal_size = 3;
+    const int offset = kernal_size / 2;
+
+    Pixeldata** original_pixels = copy_pixels(image.pixels, image.height, image.width);
+
+    // rows are independent once the original is copied
+    parallel_for(offset, image.height - offset, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            for (int x = offset; x < image.width - offset; x++) {
+                float sumR = 0;
+                float sumG = 0;
+                float sumB = 0;
+
+                for (int ky = -offset; ky <= offset; ky++) {
+                    for (int kx = -offset; kx <= offset; kx++) {
+
+                        float weight = GAUSSIAN_KERNEL[ky + offset][kx + offset];
+                        Pixeldata& pixel = original_pixels[y + ky][x + kx];
+
+                        sumR += pixel.R * weight;
+                        sumG += pixel.G * weight;
+                        sumB += pixel.B * weight;
+                    }
+                }
+
+                // Clamp results to 0-255
+                image.pixels[y][x].R = static_cast<BYTE>(std::clamp(sumR, 0.0f, 255.0f));
+                image.pixels[y][x].G = static_cast<BYTE>(std::clamp(sumG, 0.0f, 255.0f));
+                image.pixels[y][x].B = static_cast<BYTE>(std::clamp(sumB, 0.0f, 255.0f));
+            }
+        }
+    });
+
+    for (int i = 0; i < image.height; i++) {
+        delete[] original_pixels[i];
+    }
+    delete[] original_pixels;
+}
+
+// one pass of a 3x3 blur as two passes of 3 taps in integers, the gaussian's sums are the float
+// kernel's exactly so it matches applyGaussianBlur, the box is the cheaper approximation
+void separable_blur(ImageDetails& image, bool box) {
+    Pixeldata** original_pixels = copy_pixels(image.pixels, image.height, image.width);
+    int centre = box ? 1 : 2;
+    int bytes = image.width * 3;
+
+    parallel_for(1, image.height - 1, 0, [&](int start, int end) {
+        // horizontal sums of the rows above, at and below the one being written
+        std::vector<int> above(bytes), here(bytes), below(bytes);
+        auto horizontal = [&](int y, std::vector<int>& sums) {
+            const BYTE* row = reinterpret_cast<const BYTE*>(original_pixels[y]);
+            for (int i = 3; i < bytes - 3; i++) {
+                sums[i] = row[i - 3] + centre * row[i] + row[i + 3];
+            }
+        };
+        horizontal(start - 1, above);
+        horizontal(start, here);
+        for (int y = start; y < end; y++) {
+            horizontal(y + 1, below);
+            BYTE* row = reinterpret_cast<BYTE*>(image.pixels[y]);
+            for (int i = 3; i < bytes - 3; i++) {
+                int sum = above[i] + centre * here[i] + below[i];
+                row[i] = box ? sum / 9 : sum >> 4;
+            }
+            std::swap(above, here);
+            std::swap(here, below);
+        }
+    });
+
+    for (int i = 0; i < image.height; i++) {
+        delete[] original_pixels[i];
+    }
+    delete[] original_pixels;
+}
+
+// one blur pass at the given quality, the exact blur by whichever way plan_filter expects to be faster
+void blur_pass(ImageDetails& image, filter_quality quality, filter_algorithm algorithm) {
+    if (quality == QUALITY_FAST) {
+        separable_blur(image, true);
+        return;
+    }
+    if (algorithm == ALGORITHM_AUTO) {
+        algorithm = plan_filter(FILTER_GAUSSIAN_BLUR, image.width, image.height, 1, quality).algorithm;
+    }
+    if (algorithm == ALGORITHM_SEPARABLE) {
+        separable_blur(image, false);
+    } else {
+        applyGaussianBlur(image);
+    }
+}
+
+void applySharpen(ImageDetails& image, int filter_strength, filter_quality quality) {
+    // the same steps as below in one pass over the image and the blurred copy
+    if (quality != QUALITY_EXACT) {
+        ImageDetails blured_image;
+        blured_image.width = image.width;
+        blured_image.height = image.height;
+        blured_image.pixels = copy_pixels(image.pixels, image.height, image.width);
+        blur_pass(blured_image, quality);
+        parallel_for(0, image.height, 0, [&](int start, int end) {
+            for (int y = start; y < end; y++) {
+                BYTE* row = reinterpret_cast<BYTE*>(image.pixels[y]);
+                const BYTE* blurred = reinterpret_cast<const BYTE*>(blured_image.pixels[y]);
+                for (int i = 0; i < image.width * 3; i++) {
+                    // the mask is a byte, so it wraps like subtract_images
+                    BYTE mask = row[i] - blurred[i];
+                    row[i] = std::min(255, row[i] + std::min(255, mask * filter_strength));
+                }
+            }
+        });
+        freeImage(blured_image);
+        return;
+    }
+
+    // Deep copy for blurred image
+    ImageDetails blured_image;
+    blured_image.width = image.width;
+    blured_image.height = image.height;
+    blured_image.pixels = copy_pixels(image.pixels, image.height, image.width);
+
+    blur_pass(blured_image, quality);
+
+    // Allocate sharpened mask
+    ImageDetails sharpend_mask;
+    sharpend_mask.width = image.width;
+    sharpend_mask.height = image.height;
+    sharpend_mask.pixels = copy_pixels(image.pixels, image.height, image.width);
+
+    subtract_images(image, blured_image, sharpend_mask);
+    multiply_image(sharpend_mask, filter_strength);
+    add_images(image, sharpend_mask, image);
+
+    // Clamp the values to 0-255
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            image.pixels[y][x].R = std::clamp(int(image.pixels[y][x].R), 0, 255);
+            image.pixels[y][x].G = std::clamp(int(image.pixels[y][x].G), 0, 255);
+            image.pixels[y][x].B = std::clamp(int(image.pixels[y][x].B), 0, 255);
+        }
+    }
+
+    freeImage(blured_image);
+    freeImage(sharpend_mask);
+}
+
+// round(sqrt(i)) for every sum of squares below 255.5 squared, anything above is 255 anyway
+const BYTE* edge_magnitudes() {
+    static std::vector<BYTE> table = [] {
+        std::vector<BYTE> magnitudes(65281);
+        for (size_t i = 0; i < magnitudes.size(); i++) {
+            magnitudes[i] = round(sqrt(i));
+        }
+        return magnitudes;
+    }();
+    return table.data();
+}
+
+void applyEdgeDetection(ImageDetails& image, filter_quality quality) {
+    int Gx[3][3] = {
+        {-1, 0, 1},
+        {-2, 0, 2},
+        {-1, 0, 1}
+    };
+
+    int Gy[3][3] = {
+        {1, 2, 1},
+        {0,  0,  0},
+        {-1,  -2,  -1}
+    };
+
+    // Deep copy
+    ImageDetails temp_image;
+    temp_image.pixels = copy_pixels(image.pixels, image.height, image.width);
+    temp_image.height = image.height;
+    temp_image.width = image.width;
+
+    // Grayscale must update all channels
+    applyGrayscale(temp_image);
+    const BYTE* magnitudes = edge_magnitudes();
+
+    // Avoid borders
+    parallel_for(1, image.height - 1, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            for (int x = 1; x < image.width - 1; x++) {
+                int gx = 0, gy = 0;
+
+                for (int ky = 0; ky < 3; ky++) {
+                    for (int kx = 0; kx < 3; kx++) {
+                        int px = x + kx - 1;
+                        int py = y + ky - 1;
+                        BYTE intensity = temp_image.pixels[py][px].R;
+                        gx += intensity * Gx[ky][kx];
+                        gy += intensity * Gy[ky][kx];
+                    }
+                }
+
+                int magnitude;
+                if (quality == QUALITY_EXACT) {
+                    magnitude = round(sqrt(gx * gx + gy * gy));
+                } else if (quality == QUALITY_BALANCED) {
+                    int squares = gx * gx + gy * gy;
+                    magnitude = squares < 65281 ? magnitudes[squares] : 255;
+                } else {
+                    // L1 is never below the true magnitude and at most 1.41 times it
+                    magnitude = abs(gx) + abs(gy);
+                }
+                if (magnitude > 255) magnitude = 255;
+                if (magnitude < 0) magnitude = 0;
+
+                image.pixels[y][x].R = magnitude;
+                image.pixels[y][x].G = magnitude;
+                image.pixels[y][x].B = magnitude;
+            }
+        }
+    });
+
+    freeImage(temp_image); // only if it’s safe
+}
+
+// median of each row's window, then the median of those down each column's window, about the
+// true median at 2 x window samples a pixel instead of window squared
+void separable_median(ImageDetails& image, int offset) {
+    ImageDetails rows;
+    if (create_image(rows, image.width, image.height) != 0) {
+        return;
+    }
+    int window = 2 * offset + 1;
+    auto median = [](BYTE* samples, int count) {
+        std::nth_element(samples, samples + count / 2, samples + count);
+        return samples[count / 2];
+    };
+
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        BYTE samples[3][window];
+        for (int y = start; y < end; y++) {
+            for (int x = 0; x < image.width; x++) {
+                int count = 0;
+                for (int sample_x = std::max(0, x - offset); sample_x <= std::min(image.width - 1, x + offset); sample_x++) {
+                    samples[0][count] = image.pixels[y][sample_x].R;
+                    samples[1][count] = image.pixels[y][sample_x].G;
+                    samples[2][count] = image.pixels[y][sample_x].B;
+                    count++;
+                }
+                rows.pixels[y][x].R = median(samples[0], count);
+                rows.pixels[y][x].G = median(samples[1], count);
+                rows.pixels[y][x].B = median(samples[2], count);
+            }
+        }
+    });
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        BYTE samples[3][window];
+        for (int y = start; y < end; y++) {
+            for (int x = 0; x < image.width; x++) {
+                int count = 0;
+                for (int sample_y = std::max(0, y - offset); sample_y <= std::min(image.height - 1, y + offset); sample_y++) {
+                    samples[0][count] = rows.pixels[sample_y][x].R;
+                    samples[1][count] = rows.pixels[sample_y][x].G;
+                    samples[2][count] = rows.pixels[sample_y][x].B;
+                    count++;
+                }
+                image.pixels[y][x].R = median(samples[0], count);
+                image.pixels[y][x].G = median(samples[1], count);
+                image.pixels[y][x].B = median(samples[2], count);
+            }
+        }
+    });
+    freeImage(rows);
+}
+
+// median of every window from a histogram per channel slid along each row, each step only adds
+// and removes a column of the window so the cost grows with its height rather than its area
+void histogram_median(ImageDetails& image, int offset) {
+    Pixeldata** original_pixels = copy_pixels(image.pixels, image.height, image.width);
+
+    parallel_for(0, image.height, 2, [&](int start, int end) {
+        int histogram[3][256];
+        // each channel's median so far and how many samples are below it
+        int median[3];
+        int below[3];
+        for (int y = start; y < end && !filter_cancelled(); y++) {
+            int top = std::max(0, y - offset);
+            int bottom = std::min(image.height - 1, y + offset);
+            memset(histogram, 0, sizeof(histogram));
+            for (int c = 0; c < 3; c++) {
+                median[c] = 0;
+                below[c] = 0;
+            }
+            // add (1) or remove (-1) a column of the window
+            auto update = [&](int x, int change) {
+                for (int sample_y = top; sample_y <= bottom; sample_y++) {
+                    const BYTE* pixel = reinterpret_cast<const BYTE*>(&original_pixels[sample_y][x]);
+                    for (int c = 0; c < 3; c++) {
+                        histogram[c][pixel[c]] += change;
+                        if (pixel[c] < median[c]) below[c] += change;
+                    }
+                }
+            };
+
+            for (int x = 0; x <= std::min(offset, image.width - 1); x++) {
+                update(x, 1);
+            }
+            for (int x = 0; x < image.width; x++) {
+                if (x > offset) update(x - offset - 1, -1);
+                if (x > 0 && x + offset < image.width) update(x + offset, 1);
+
+                // the same sample as sorting the clipped window and taking the middle one
+                int count = (bottom - top + 1) * (std::min(image.width - 1, x + offset) - std::max(0, x - offset) + 1);
+                int middle = count / 2;
+                BYTE* out = reinterpret_cast<BYTE*>(&image.pixels[y][x]);
+                for (int c = 0; c < 3; c++) {
+                    while (below[c] > middle) {
+                        median[c]--;
+                        below[c] -= histogram[c][median[c]];
+                    }
+                    while (below[c] + histogram[c][median[c]] <= middle) {
+                        below[c] += histogram[c][median[c]];
+                        median[c]++;
+                    }
+                    out[c] = median[c];
+                }
+            }
+        }
+    });
+
+    for (int i = 0; i < image.height; i++) {
+        delete[] original_pixels[i];
+    }
+    delete[] original_pixels;
+}
+
+// how far the noise reduction window reaches either side of a pixel
+int noise_reduction_offset(int filter_strength) {
+    // kernal size must be odd
+    if (filter_strength % 2 != 0) {
+        filter_strength++;
+        // use half strength
+        filter_strength /= 2;
+    }
+
+    int kernel_size = 3 + filter_strength;
+    return kernel_size / 2;
+}
+
+// note this filter takes awhile due to the sorting
+void applyNoiseReduction(ImageDetails& image, int filter_strength, filter_quality quality, filter_algorithm algorithm) {
+    int offset = noise_reduction_offset(filter_strength);
+    // samples actually taken, an even kernel size still reaches offset either side
+    int window = 2 * offset + 1;
+
+    if (quality == QUALITY_FAST) {
+        separable_median(image, offset);
+        return;
+    }
+    if (algorithm == ALGORITHM_AUTO) {
+        algorithm = plan_filter(FILTER_NOISE_REDUCTION, image.width, image.height, filter_strength, quality).algorithm;
+    }
+    if (algorithm == ALGORITHM_HISTOGRAM) {
+        histogram_median(image, offset);
+        return;
+    }
+
+    // Copy the original pixels
+    Pixeldata** original_pixels = copy_pixels(image.pixels, image.height, image.width);
+
+    // a big window makes each pixel slow, so check for cancel about every thousand samples
+    int check_interval = std::max(1, 1024 / (window * window));
+
+    // Loop over every pixel, in small bands since the cost per row varies
+    parallel_for(0, image.height, 2, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            for (int x = 0; x < image.width; x++) {
+                if (x % check_interval == 0 && filter_cancelled()) break;
+
+                BYTE Red[window * window];
+                BYTE Green[window * window];
+                BYTE Blue[window * window];
+
+                int index = 0;
+
+                // Collect pixel values in the kernel
+                for (int ky = -offset; ky <= offset; ky++) {
+                    for (int kx = -offset; kx <= offset; kx++) {
+                        int sample_y = y + ky;
+                        int sample_x = x + kx;
+
+                        // Check bounds
+                        if (sample_y >= 0 && sample_y < image.height &&
+                            sample_x >= 0 && sample_x < image.width) {
+                            Pixeldata& pixel = original_pixels[sample_y][sample_x];
+                            Red[index] = pixel.R;
+                            Green[index] = pixel.G;
+                            Blue[index] = pixel.B;
+                            index++;
+                        }
+                    }
+                }
+
+                // Sort the collected values, or just find the middle one, which is the same value
+                if (algorithm == ALGORITHM_DIRECT) {
+                    ascending_sort(Red, index);
+                    ascending_sort(Green, index);
+                    ascending_sort(Blue, index);
+                } else {
+                    std::nth_element(Red, Red + index / 2, Red + index);
+                    std::nth_element(Green, Green + index / 2, Green + index);
+                    std::nth_element(Blue, Blue + index / 2, Blue + index);
+                }
+
+                // Set the pixel to the median value
+                if (index > 0) {
+                    int r = Red[index / 2];
+                    int g = Green[index / 2];
+                    int b = Blue[index / 2];
+                            
+                    // Scale up for visibility (try 2, 4, or higher if needed)
+                    image.pixels[y][x].R = r;
+                    image.pixels[y][x].G = g;
+                    image.pixels[y][x].B = b;
+                }
+
+            }
+        }
+    });
+
+    // Free memory
+    for (int i = 0; i < image.height; i++) {
+        delete[] original_pixels[i];
+    }
+    delete[] original_pixels;
+}
+
+// one channel of a suspect pixel: the median of the smallest window whose median isn't one of its
+// extremes, or of the largest window, and the pixel keeps its value if it isn't an extreme either
+BYTE adaptive_median(Pixeldata** pixels, int width, int height, int x, int y, int channel, int max_offset, BYTE samples[]) {
+    BYTE value = reinterpret_cast<const BYTE*>(&pixels[y][x])[channel];
+    BYTE median = value;
+    for (int offset = 1; offset <= max_offset; offset++) {
+        int count = 0;
+        for (int sample_y = std::max(0, y - offset); sample_y <= std::min(height - 1, y + offset); sample_y++) {
+            for (int sample_x = std::max(0, x - offset); sample_x <= std::min(width - 1, x + offset); sample_x++) {
+                samples[count++] = reinterpret_cast<const BYTE*>(&pixels[sample_y][sample_x])[channel];
+            }
+        }
+        auto extremes = std::minmax_element(samples, samples + count);
+        BYTE lowest = *extremes.first;
+        BYTE highest = *extremes.second;
+        std::nth_element(samples, samples + count / 2, samples + count);
+        median = samples[count / 2];
+        if (lowest < median && median < highest) {
+            return lowest < value && value < highest ? value : median;
+        }
+    }
+    return median;
+}
+
+// salt and pepper removal that only spends time on the noise: a channel is a suspect when it is 0
+// or 255, the values the noise sets, and the extreme of a 3x3 neighbourhood that isn't all that
+// value. Only suspects get medians, so the cost follows how noisy the image is
+void applyAdaptiveMedian(ImageDetails& image, int filter_strength) {
+    int max_offset = noise_reduction_offset(filter_strength);
+    int window = 2 * max_offset + 1;
+    int bytes = image.width * 3;
+    Pixeldata** original_pixels = copy_pixels(image.pixels, image.height, image.width);
+
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        // the 3x3 lows and highs per byte, the column ones with a pixel either side repeating the edge
+        std::vector<BYTE> column_low(bytes + 6), column_high(bytes + 6);
+        std::vector<BYTE> suspect(bytes);
+        BYTE samples[window * window];
+        for (int y = start; y < end; y++) {
+            const BYTE* above = reinterpret_cast<const BYTE*>(original_pixels[std::max(0, y - 1)]);
+            const BYTE* here = reinterpret_cast<const BYTE*>(original_pixels[y]);
+            const BYTE* below = reinterpret_cast<const BYTE*>(original_pixels[std::min(image.height - 1, y + 1)]);
+
+            // straight byte loops so they vectorise
+            for (int i = 0; i < bytes; i++) {
+                column_low[i + 3] = std::min(std::min(above[i], here[i]), below[i]);
+                column_high[i + 3] = std::max(std::max(above[i], here[i]), below[i]);
+            }
+            for (int i = 0; i < 3; i++) {
+                column_low[i] = column_low[i + 3];
+                column_high[i] = column_high[i + 3];
+                column_low[bytes + 3 + i] = column_low[bytes + i];
+                column_high[bytes + 3 + i] = column_high[bytes + i];
+            }
+            for (int i = 0; i < bytes; i++) {
+                BYTE low = std::min(std::min(column_low[i], column_low[i + 3]), column_low[i + 6]);
+                BYTE high = std::max(std::max(column_high[i], column_high[i + 3]), column_high[i + 6]);
+                suspect[i] = (here[i] == 0 && high > 0) || (here[i] == 255 && low < 255);
+            }
+
+            BYTE* row = reinterpret_cast<BYTE*>(image.pixels[y]);
+            for (int i = 0; i < bytes; i++) {
+                if (suspect[i]) {
+                    row[i] = adaptive_median(original_pixels, image.width, image.height, i / 3, y, i % 3, max_offset, samples);
+                }
+            }
+        }
+    });
+
+    for (int i = 0; i < image.height; i++) {
+        delete[] original_pixels[i];
+    }
+    delete[] original_pixels;
+}
+
+// median of the same pixel across the frames in the window, channel by channel
+void applyTemporalMedian(ImageDetails& frame, const std::vector<ImageDetails>& frames, int count) {
+    parallel_for(0, frame.height, 0, [&](int start, int end) {
+        BYTE Red[TEMPORAL_MAX_FRAMES];
+        BYTE Green[TEMPORAL_MAX_FRAMES];
+        BYTE Blue[TEMPORAL_MAX_FRAMES];
+        for (int y = start; y < end; y++) {
+            for (int x = 0; x < frame.width; x++) {
+                for (int k = 0; k < count; k++) {
+                    const Pixeldata& pixel = frames[k].pixels[y][x];
+                    Red[k] = pixel.R;
+                    Green[k] = pixel.G;
+                    Blue[k] = pixel.B;
+                }
+                ascending_sort(Red, count);
+                ascending_sort(Green, count);
+                ascending_sort(Blue, count);
+                frame.pixels[y][x].R = Red[count / 2];
+                frame.pixels[y][x].G = Green[count / 2];
+                frame.pixels[y][x].B = Blue[count / 2];
+            }
+        }
+    });
+}
+
+// mean of the same pixel across the frames in the window, leaving out frames where it has moved
+void applyTemporalAverage(ImageDetails& frame, const std::vector<ImageDetails>& frames, int count) {
+    parallel_for(0, frame.height, 0, [&](int start, int end) {
+        const Pixeldata* rows[TEMPORAL_MAX_FRAMES];
+        for (int y = start; y < end; y++) {
+            for (int k = 0; k < count; k++) {
+                rows[k] = frames[k].pixels[y];
+            }
+            for (int x = 0; x < frame.width; x++) {
+                Pixeldata current = frame.pixels[y][x];
+                int sumR = 0;
+                int sumG = 0;
+                int sumB = 0;
+                int used = 0;
+                // no branches so the compiler can vectorise it, the current frame always counts
+                for (int k = 0; k < count; k++) {
+                    const Pixeldata& pixel = rows[k][x];
+                    int difference = abs(pixel.R - current.R) + abs(pixel.G - current.G) + abs(pixel.B - current.B);
+                    int still = difference <= TEMPORAL_MOTION_THRESHOLD;
+                    sumR += still * pixel.R;
+                    sumG += still * pixel.G;
+                    sumB += still * pixel.B;
+                    used += still;
+                }
+                frame.pixels[y][x].R = (sumR + used / 2) / used;
+                frame.pixels[y][x].G = (sumG + used / 2) / used;
+                frame.pixels[y][x].B = (sumB + used / 2) / used;
+            }
+        }
+    });
+}
+
+AsciiFilter* ASCII_filter(ImageDetails& image) {
+
+    // apply grayscale filter
+    applyGrayscale(image);
+
+    // Find min and max grayscale values
+    int min_val = 255, max_val = 0;
+    for (int y = 0; y < image.height; y++)
+        for (int x = 0; x < image.width; x++) {
+            int val = image.pixels[y][x].R;
+            if (val < min_val) min_val = val;
+            if (val > max_val) max_val = val;
+        }
+    // Stretch values
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            int val = image.pixels[y][x].R;
+            int stretched = 255 * (val - min_val) / (max_val - min_val + 1);
+            image.pixels[y][x].R = image.pixels[y][x].G = image.pixels[y][x].B = stretched;
+        }
+    }
+
+    // apply ASCII filter
+    AsciiFilter* ascii_image = new AsciiFilter;
+    ascii_image->width = image.width;  
+    ascii_image->height = image.height;
+    // allocate memory for ASCII pixel data
+    ascii_image->pixels = new char*[ascii_image->height];
+    for (int i = 0; i < ascii_image->height; i++) {
+        ascii_image->pixels[i] = new char[ascii_image->width];
+    }
+
+    const char* ascii_chars = " `.-':_,^=;><+!rc*/z?sLTv)J7(|Fi{C}fI31tlu[neoZ5Yxjya]2ESwqkP6h9d4VpOGbUAKXHm8RD#$Bg0MNWQ%&@";
+    // 50 levels of brightness
+    // const char* ascii_chars = "@%&#akdpwZ0LJYxvnrft/|()1{}[]?-_+~<>i!lI;:,^'. "; // 50 levels of brightness
+    int num_chars = strlen(ascii_chars);
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            int index = (image.pixels[y][x].R * (num_chars - 1)) / 255;
+            ascii_image->pixels[y][x] = ascii_chars[index];
+        }
+    }
+    return ascii_image;
+}
+
+//save ASCII image to txt file
+void saveAsciiImage(AsciiFilter* ascii_image, string& filename){
+    // open file
+    std::ofstream out(filename);
+
+    if (!out) {
+        std::cerr << "Error: Could not open file " << filename << " for writing." << std::endl;
+        return;
+    }
+
+    for (int y = ascii_image->height - 1; y >= 0; y--) {
+        for (int x = 0; x < ascii_image->width; x++) {
+            out << ascii_image->pixels[y][x];
+        }
+        out << "\n";
+    }
+
+    // close file
+    out.close();
+}
+
+// free memory
+void freeAsciiImage(AsciiFilter* ascii_image) {
+    for (int i = 0; i < ascii_image->height; i++) {
+        delete[] ascii_image->pixels[i];
+    }
+    delete[] ascii_image->pixels;
+    delete ascii_image;
+}
+
+void changeImageSize(ImageDetails& image, int new_width) {
+    // adjust for font
+    float aspect_ratio = 0.4f; 
+    // calculate height based on aspect ratio
+    int new_height = static_cast<int>(image.height * (new_width / (float)image.width) * aspect_ratio);
+
+    // check if the new deminsions are valid
+    if (new_width > image.width || new_height > image.height) {
+        std::cerr << "Error: New size is larger than original image dimensions." << std::endl;
+        return;
+    }
+
+    //make kernel size
+    int kernal_size_x = image.width / new_width;
+    int kernal_size_y = image.height / new_height;
+    if (kernal_size_x <= 0 || kernal_size_y <= 0) {
+        std::cerr << "Error: Kernel size is zero or negative. New size too large for image." << std::endl;
+        return;
+    }
+
+    // allocate memory for new pixels
+    Pixeldata** new_pixels = new Pixeldata*[new_height];
+    for (int i = 0; i < new_height; i++) {
+        new_pixels[i] = new Pixeldata[new_width];
+    }
+
+    // iterate through x and y 
+    for (int y = 0; y < new_height; y++) {
+        for (int x = 0; x < new_width; x++) {
+            int sumR = 0, sumG = 0, sumB = 0, count = 0;
+            for (int ky = 0; ky < kernal_size_y; ky++) {
+                for (int kx = 0; kx < kernal_size_x; kx++) {
+                    // move the pixels scaling by kernel size
+                    int sourceY = y * kernal_size_y + ky;
+                    int sourceX = x * kernal_size_x + kx;
+                    if (sourceY < image.height && sourceX < image.width) {
+                        sumR += image.pixels[sourceY][sourceX].R;
+                        sumG += image.pixels[sourceY][sourceX].G;
+                        sumB += image.pixels[sourceY][sourceX].B;
+                        count++;
+                    }
+                }
+            }
+            if (count == 0) count = 1;
+            new_pixels[y][x].R = sumR / count;
+            new_pixels[y][x].G = sumG / count;
+            new_pixels[y][x].B = sumB / count;
+        }
+    }
+
+    // free old image
+    for (int i = 0; i < image.height; i++) {
+        delete[] image.pixels[i];
+    }
+    delete[] image.pixels;
+
+    // update image
+    image.pixels = new_pixels;
+    image.width = new_width;
+    image.height = new_height;
+}
@@ -0,0 +1,489 @@
+// filter_lib.h - BMP Image Filtering Library
+// Loading, filtering and saving BMP images, from files or from memory. Used by the filter program
+// and by anything that wants to filter images in-process (see filter_c.h for the C interface).
+
+#ifndef FILTER_LIB_H
+#define FILTER_LIB_H
+
+// libaries
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <map>
+#include <mutex>
+using std::string;
+
+// data type aliases
+typedef uint8_t  BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+
+//bitmap header struct
+// ref: https://learn.microsoft.com/en-us/windows/win32/api/wingdi/ns-wingdi-bitmapfileheader?redirectedfrom=MSDN
+
+#pragma pack(push, 1)
+struct BitmapFileHeader {
+    WORD bfType;        // Magic number for file
+    DWORD bfSize;      // Size of the file in bytes
+    WORD bfReserved1;  // Reserved, must be 0
+    WORD bfReserved2;  // Reserved, must be 0
+    DWORD bfOffBits;   // Offset to start of pixel data
+};
+#pragma pack(pop)
+//bitmap info struct
+// ref: https://learn.microsoft.com/en-us/windows/win32/api/wingdi/ns-wingdi-bitmapinfoheader?redirectedfrom=MSDN
+#pragma pack(push, 1)
+struct BitmapInfoHeader {
+    DWORD biSize;          // Size of this header
+    LONG biWidth;          // Width of the bitmap
+    LONG biHeight;         // Height of the bitmap
+    WORD biPlanes;        // Number of color planes
+    WORD biBitCount;      // Bits per pixel
+    DWORD biCompression;  // Compression type
+    DWORD biSizeImage;    // Size of the image data
+    LONG biXPelsPerMeter;  // Horizontal resolution
+    LONG biYPelsPerMeter;  // Vertical resolution
+    DWORD biClrUsed;      // Number of colors used
+    DWORD biClrImportant; // Important colors
+};
+#pragma pack(pop)
+
+// pixel data struct 
+struct Pixeldata{
+    BYTE B;
+    BYTE G;
+    BYTE R;
+};
+
+// image struct
+struct ImageDetails {
+    int width;
+    int height;
+    Pixeldata** pixels;
+};
+
+// scheduling classes, each gets its share of the cpu when they compete (see scheduler_set_share)
+enum job_priority {
+    PRIORITY_HIGH,        // interactive work, waiting on it never runs anything lower
+    PRIORITY_NORMAL,
+    PRIORITY_LOW,         // background batches
+    PRIORITY_CLASSES
+};
+
+// how closely filters follow their reference algorithms, the faster tiers allow small differences
+enum filter_quality {
+    QUALITY_FAST,         // cheaper approximations, such as a box blur or L1 edge magnitude
+    QUALITY_BALANCED,     // faster code with the same results, or within 1
+    QUALITY_EXACT         // the reference algorithms
+};
+
+// ways to compute a filter that give the same output, ALGORITHM_AUTO leaves the choice to plan_filter
+enum filter_algorithm {
+    ALGORITHM_AUTO,
+    ALGORITHM_DIRECT,     // the filter's reference loop
+    ALGORITHM_SEPARABLE,  // a blur pass as integer row and column passes
+    ALGORITHM_SELECT,     // median by partially sorting each window
+    ALGORITHM_HISTOGRAM   // median from histograms slid along each row
+};
+
+// where an overlay is placed on the image
+enum overlay_position {
+    OVERLAY_TOP_LEFT,
+    OVERLAY_TOP_RIGHT,
+    OVERLAY_BOTTOM_LEFT,
+    OVERLAY_BOTTOM_RIGHT,
+    OVERLAY_CENTRE
+};
+
+// an overlay at one size, only the box of it that isn't transparent, as premultiplied colour and
+// 255 - alpha for each byte of the image it covers, rows top down
+struct overlay_plane {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<BYTE> colour;
+    std::vector<BYTE> keep;
+};
+
+// an image composited over others, premultiplied once when loaded and resized once per size it is
+// drawn at, so a batch stamping it on every image does neither per image
+struct overlay_source {
+    int width = 0;
+    int height = 0;
+    // B, G, R and alpha, the colours premultiplied by alpha, rows top down
+    std::vector<float> pixels;
+    overlay_position position = OVERLAY_BOTTOM_RIGHT;
+    mutable std::mutex lock;
+    mutable std::map<std::pair<int, int>, overlay_plane> sizes;
+};
+
+// how much of a block of pixels a mix changes
+enum mask_coverage {
+    MASK_EMPTY,     // none of it, the source is the output
+    MASK_PARTIAL,   // some of it, the filtered pixels are blended
+    MASK_FULL       // all of it, the filtered pixels are the output
+};
+
+// the mask is summarised in blocks this size so tiles can be skipped without reading it
+const int MASK_BLOCK = 16;
+
+// how much a filter's result counts at each pixel, one byte per pixel in the image's row order,
+// 0 keeps the source and 255 the filtered pixel
+struct filter_mask {
+    int width = 0;
+    int height = 0;
+    std::vector<BYTE> values;
+    // a mask_coverage per MASK_BLOCK square, row by row
+    int blocks_x = 0;
+    int blocks_y = 0;
+    std::vector<BYTE> blocks;
+};
+
+// ids of the built in filters, as shown in the program's menu
+enum builtin_filter {
+    FILTER_NONE = 0,
+    FILTER_GRAYSCALE = 1,
+    FILTER_SEPIA = 2,
+    FILTER_FLIP = 3,
+    FILTER_GAUSSIAN_BLUR = 4,
+    FILTER_SHARPEN = 5,
+    FILTER_EDGE_DETECTION = 6,
+    FILTER_NOISE_REDUCTION = 7,
+    FILTER_ASCII = 8,
+    FILTER_VERTICAL_FLIP = 9,
+    FILTER_TEMPORAL_MEDIAN = 10,
+    FILTER_TEMPORAL_AVERAGE = 11,
+    FILTER_QUANTISE = 12,
+    FILTER_QUANTISE_DITHERED = 13,
+    FILTER_ADAPTIVE_MEDIAN = 14,
+    FILTER_WIDE_BLUR = 15,
+    FILTER_CLARITY = 16,
+    FILTER_OVERLAY = 17
+};
+
+// what a filter reads to produce an output pixel, used to pick how it gets run
+enum filter_kind {
+    FILTER_HEADER_ONLY,   // pixels are untouched, at most the header changes
+    FILTER_POINT,         // only the same pixel
+    FILTER_ROW,           // only pixels in the same row
+    FILTER_STENCIL,       // pixels within halo(strength) of it
+    FILTER_GLOBAL,        // anything in the image
+    FILTER_TEMPORAL       // the same pixel in earlier frames, only in sequence mode
+};
+
+// lets a caller stop a running filter, checked once per band of rows
+struct cancel_token {
+    mutable std::atomic<bool> cancelled{false};
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // cancelling the parent cancels this one too
+    const cancel_token* parent = nullptr;
+};
+
+// everything a filter gets besides the image
+struct filter_params {
+    int strength = 0;
+    const cancel_token* cancel = nullptr;
+    job_priority priority = PRIORITY_NORMAL;
+    filter_quality quality = QUALITY_EXACT;
+    filter_algorithm algorithm = ALGORITHM_AUTO;
+    // percent of the filtered result blended with the source, scaled per pixel by the mask if set
+    int mix = 100;
+    const filter_mask* mask = nullptr;
+    // for the overlay filter, and which way up the image's rows are for placing it
+    const overlay_source* overlay = nullptr;
+    bool top_down = false;
+};
+
+// makes a token current on this thread for its lifetime, parallel_for passes it on to its tasks
+struct cancel_scope {
+    const cancel_token* previous;
+    explicit cancel_scope(const cancel_token* token);
+    ~cancel_scope();
+};
+
+// runs tasks submitted on this thread at a priority for its lifetime
+struct priority_scope {
+    job_priority previous;
+    explicit priority_scope(job_priority priority);
+    ~priority_scope();
+};
+
+// parallel_for runs its body straight through on this thread for the scope's lifetime
+struct serial_scope {
+    bool previous;
+    serial_scope();
+    ~serial_scope();
+};
+
+// registry entry describing a filter
+struct filter_info {
+    string name;
+    bool has_parameters;
+    filter_kind kind;
+    int (*halo)(int strength);                  // stencil radius in pixels
+    float (*cost)(int strength);                // work per pixel, grayscale is 1
+    bool in_place;                              // apply_row can run on the rows of a mapped file
+    int output_channels;                        // channels the result carries, 1 when it is gray, for callers to read
+    bool palettised;                            // result has at most 256 colours, saved as an 8 bit bmp
+    void (*apply)(ImageDetails& image, const filter_params& params);
+    void (*apply_row)(Pixeldata* row, int width, const filter_params& params);   // point and row filters
+    void (*apply_header)(BitmapInfoHeader& info_header);                         // header only filters
+    void (*apply_frames)(ImageDetails& frame, const std::vector<ImageDetails>& frames, int count, const filter_params& params);   // temporal filters
+};
+
+
+struct AsciiFilter {
+    int width;
+    int height;
+    char** pixels;
+};
+
+// work (pixels x registry cost) below which splitting one image into bands costs more than it saves
+const float MIN_SPLIT_WORK = 1 << 20;
+
+// work for the task scheduler
+typedef std::function<void()> task_function;
+
+// tasks submitted together, waited on together
+struct task_group {
+    std::atomic<int> pending{0};
+    job_priority priority = PRIORITY_NORMAL;
+};
+
+// nanoseconds per pixel measured on this host, the cost model plan_filter chooses with
+struct dispatch_model {
+    float unit_ns;                // one unit of registry cost, from grayscale
+    float blur_direct_ns;         // a pass of the 3x3 float kernel
+    float blur_separable_ns;      // a pass of the integer separable kernel
+    float select_ns;              // median by selection, fixed part
+    float select_sample_ns;       // and per sample in the window
+    float histogram_ns;           // histogram median, fixed part
+    float histogram_update_ns;    // and per sample added to or removed from the histograms
+    float parallel_ns;            // starting and joining a parallel_for, not per pixel
+    int threads;
+};
+
+// how one call of a filter runs
+struct filter_plan {
+    filter_algorithm algorithm;
+    bool serial;                  // too little work to repay spreading it over threads
+    float predicted_ns;           // on one thread
+};
+
+// a level of an image pyramid, channels interleaved like the image's pixels
+struct pyramid_level {
+    int width;
+    int height;
+    std::vector<float> pixels;
+};
+
+// how far apart two images are, from compare_images
+struct image_comparison {
+    double mse;           // mean squared error over every channel
+    double psnr;          // in dB, infinite when identical
+    double ssim;          // mean over 8x8 windows of the luma, 1 when identical
+    int max_error;        // largest difference in any channel
+};
+
+// one output of a fan out, filtered from a source image shared with the other branches
+struct fan_out_branch {
+    int filter_id;
+    int strength;
+    ImageDetails image;               // the result, rows belong to the source when shared_rows is set
+    bool shared_rows;
+    BitmapInfoHeader info_header;     // the source's, as changed by a header only filter
+    int result;                       // as apply_filter
+};
+
+// where a pipeline stage is computed
+enum stage_schedule {
+    SCHEDULE_ROOT,        // over the whole image before the next stage starts
+    SCHEDULE_TILE,        // per output tile in scratch, recomputing the margin later stages read
+    SCHEDULE_INLINE       // row by row as the stage before it produces them
+};
+
+// one filter of a pipeline, a function of the pixels within halo of each output coordinate
+struct pipeline_stage {
+    int filter_id;
+    int strength;
+    int halo;
+    stage_schedule schedule;
+};
+
+// consecutive stages run in one sweep over the image
+struct pipeline_group {
+    int first_stage;
+    int stage_count;
+    stage_schedule schedule;          // root for one stage on its own, tile, or inline when every stage is
+    int margin;                       // sum of the tiled stages' halos, what each tile is grown by
+    int tile;                         // tile size in pixels
+    bool full_width;                  // a row filter in the group needs whole rows, tiles are bands
+};
+
+struct filter_pipeline {
+    std::vector<pipeline_stage> stages;
+    std::vector<pipeline_group> groups;
+};
+
+// smallest and largest pipeline tile, and how much bigger than the tile its margin may make it
+const int PIPELINE_TILE = 128;
+const int PIPELINE_MAX_TILE = 512;
+const float PIPELINE_MAX_RECOMPUTE = 1.25f;
+
+// size of the tiles sequence mode compares and refilters, in pixels
+const int SEQUENCE_TILE = 64;
+
+// most frames a temporal filter looks back over, including the current one
+const int TEMPORAL_MAX_FRAMES = 16;
+
+// sum of the channel differences above which a pixel in an earlier frame counts as moved
+const int TEMPORAL_MOTION_THRESHOLD = 48;
+
+// the last frames of a sequence in buffers reused from frame to frame
+struct temporal_window {
+    std::vector<ImageDetails> frames;
+    int next = 0;
+    int filled = 0;
+};
+
+// the last frame of a sequence, kept to refilter only what changes in the next
+struct frame_history {
+    ImageDetails input;
+    ImageDetails output;
+    bool valid = false;
+    long long tiles_total = 0;
+    long long tiles_filtered = 0;
+};
+
+// function and procedure declaration
+void ascending_sort(BYTE colour[], int num_elements);
+void subtract_images(const ImageDetails& a, const ImageDetails& b, ImageDetails& result);
+void multiply_image(ImageDetails& img, float scalar);
+void add_images(const ImageDetails& a, const ImageDetails& b, ImageDetails& result);
+int create_image(ImageDetails& image, int width, int height);
+void freeImage(ImageDetails& image);
+bool convert_to_bmp(string filepath);
+string get_filename(const string& filepath);
+string replace_ext_with_bmp(const string& filename);
+Pixeldata** copy_pixels(Pixeldata** source, int height, int width);
+int check_and_read_file(string file_path, ImageDetails& image, BitmapFileHeader& file_header, BitmapInfoHeader& info_header);
+int read_bmp_headers(string file_path, BitmapFileHeader& file_header, BitmapInfoHeader& info_header);
+void make_output_file(string output_file_name, ImageDetails image,  string file_path, BitmapFileHeader file_header, BitmapInfoHeader info_header);
+int read_bmp_buffer(const BYTE* data, size_t size, ImageDetails& image, BitmapFileHeader& file_header, BitmapInfoHeader& info_header);
+size_t bmp_buffer_size(const ImageDetails& image);
+void encode_bmp_into(const ImageDetails& image, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header, BYTE* data);
+void encode_bmp_buffer(const ImageDetails& image, BitmapFileHeader file_header, BitmapInfoHeader info_header, std::vector<BYTE>& data);
+void make_bmp_headers(const ImageDetails& image, BitmapFileHeader& file_header, BitmapInfoHeader& info_header);
+void save_filter_output(const filter_info* filter, const string& output_file_name, const ImageDetails& image, const string& file_path, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header);
+void encode_filter_output(const filter_info* filter, const ImageDetails& image, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header, std::vector<BYTE>& data);
+string get_directory(string file_path);
+string strip_extension(string filename);
+int apply_filter(ImageDetails& image, int filter_id, int filter_strength);
+int apply_filter(ImageDetails& image, int filter_id, const filter_params& params);
+int apply_filter_chain(ImageDetails& image, const int filter_ids[], const int filter_strengths[], int count);
+void applyGrayscale(ImageDetails& image);
+void applySepia(ImageDetails& image, int filter_strength, filter_quality quality = QUALITY_EXACT);
+void applyFlip(ImageDetails& image);
+void applyVerticalFlip(ImageDetails& image);
+void grayscale_row(Pixeldata* row, int width);
+void sepia_row(Pixeldata* row, int width, int weight = 256, filter_quality quality = QUALITY_EXACT);
+void flip_row(Pixeldata* row, int width);
+void applyGaussianBlur(ImageDetails& image);
+void separable_blur(ImageDetails& image, bool box);
+void blur_pass(ImageDetails& image, filter_quality quality, filter_algorithm algorithm = ALGORITHM_AUTO);
+void applySharpen(ImageDetails& image, int filter_strength, filter_quality quality = QUALITY_EXACT);
+void applyEdgeDetection(ImageDetails& image, filter_quality quality = QUALITY_EXACT);
+void applyNoiseReduction(ImageDetails& image, int filter_strength, filter_quality quality = QUALITY_EXACT, filter_algorithm algorithm = ALGORITHM_AUTO);
+int noise_reduction_offset(int filter_strength);
+void separable_median(ImageDetails& image, int offset);
+void histogram_median(ImageDetails& image, int offset);
+void applyAdaptiveMedian(ImageDetails& image, int filter_strength);
+void applyTemporalMedian(ImageDetails& frame, const std::vector<ImageDetails>& frames, int count);
+void applyTemporalAverage(ImageDetails& frame, const std::vector<ImageDetails>& frames, int count);
+AsciiFilter* ASCII_filter(ImageDetails& image);
+void freeAsciiImage(AsciiFilter* ascii_image);
+void changeImageSize(ImageDetails& image, int new_size);
+void saveAsciiImage(AsciiFilter* ascii_image, string& filename);
+
+// filter registry (filter_registry.cpp)
+int filter_count();
+const filter_info* find_filter(int filter_id);
+int register_filter(const filter_info& info);
+
+// task scheduler (filter_scheduler.cpp)
+int scheduler_threads();
+void scheduler_submit(task_group& group, task_function function);
+void scheduler_wait(task_group& group);
+void scheduler_spawn(task_function function);
+void scheduler_notify();
+void scheduler_drive(const std::function<bool()>& done);
+void scheduler_set_share(job_priority priority, int share);
+job_priority current_priority();
+void cancel_job(const cancel_token& token);
+void set_deadline(cancel_token& token, int milliseconds);
+bool filter_cancelled();
+void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+// frame sequences (filter_sequence.cpp)
+void copy_block(const ImageDetails& from, int from_x, int from_y, ImageDetails& to, int to_x, int to_y, int width, int height);
+int filter_next_frame(frame_history& history, ImageDetails& frame, int filter_id, const filter_params& params);
+void free_frame_history(frame_history& history);
+int filter_temporal_frame(temporal_window& window, ImageDetails& frame, int filter_id, const filter_params& params);
+void free_temporal_window(temporal_window& window);
+
+// colour quantisation and palettised bmps (filter_quantise.cpp)
+int quantise_colours(int strength);
+void build_palette(const ImageDetails& image, int colours, std::vector<Pixeldata>& palette);
+void map_to_palette(ImageDetails& image, const std::vector<Pixeldata>& palette, bool dither);
+void applyQuantise(ImageDetails& image, int colours, bool dither);
+int read_palette_bmp_buffer(const BYTE* data, size_t size, ImageDetails& image, BitmapFileHeader& file_header, BitmapInfoHeader& info_header);
+int encode_palette_bmp_buffer(const ImageDetails& image, const BitmapInfoHeader& info_header, std::vector<BYTE>& data);
+
+// fan out (filter_fanout.cpp)
+int fan_out(const ImageDetails& source, const BitmapInfoHeader& info_header, std::vector<fan_out_branch>& branches, const filter_params& params);
+void free_fan_out(std::vector<fan_out_branch>& branches);
+
+// filter pipelines (filter_pipeline.cpp)
+int build_pipeline(const int filter_ids[], const int filter_strengths[], int count, filter_pipeline& pipeline);
+int run_pipeline(ImageDetails& image, const filter_pipeline& pipeline, const filter_params& params);
+string describe_pipeline(const filter_pipeline& pipeline);
+
+// algorithm and parallelism per call (filter_dispatch.cpp)
+dispatch_model get_dispatch_model();
+filter_plan plan_filter(int filter_id, int width, int height, int strength, filter_quality quality);
+
+// image pyramids (filter_pyramid.cpp)
+std::vector<float> gaussian_kernel(float sigma);
+void gaussian_plane(std::vector<float>& plane, int width, int height, float sigma);
+int pyramid_block(float sigma, int width, int height, filter_quality quality);
+void applyWideBlur(ImageDetails& image, float sigma, filter_quality quality);
+void reduce_level(int width, int height, const std::function<void(int, float*)>& load_row, pyramid_level& coarse);
+void expand_level(const pyramid_level& coarse, int width, int height, const std::function<void(int, const float*)>& use_row);
+void applyClarity(ImageDetails& image, int filter_strength);
+
+// blending with the source (filter_mix.cpp)
+int mix_weight(int percent);
+bool blends(const filter_params& params);
+void blend_row(Pixeldata* out, const Pixeldata* filtered, const Pixeldata* source, int width, int weight, const BYTE* mask);
+void blend_block(const ImageDetails& filtered, int from_x, int from_y, const ImageDetails& source, ImageDetails& to, int to_x, int to_y, int width, int height, const filter_params& params);
+mask_coverage blend_coverage(const filter_params& params, int x, int y, int width, int height);
+int load_mask(const string& mask_path, const BitmapInfoHeader& info_header, filter_mask& mask);
+
+// overlays (filter_overlay.cpp)
+overlay_source* load_overlay(const string& overlay_path, overlay_position position);
+void free_overlay(overlay_source* overlay);
+const overlay_plane& overlay_at_size(const overlay_source& overlay, int width, int height);
+void composite_row(BYTE* out, const BYTE* colour, const BYTE* keep, int count);
+void applyOverlay(ImageDetails& image, const overlay_source& overlay, int filter_strength, bool top_down);
+
+// image comparison (filter_compare.cpp)
+int compare_images(const ImageDetails& a, const ImageDetails& b, image_comparison& result, ImageDetails* diff_map);
+int run_compare_mode(const string& first_path, const string& second_path, const string& diff_path);
+
+#endif
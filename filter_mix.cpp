@@ -0,0 +1,181 @@
+// filter_mix.cpp - blending a filter's result with its source
+// Any filter can keep only part of its effect: each output pixel is source + (filtered - source)
+// * mix, with mix in 256ths so the blend is a fixed point lerp over the bytes, and a grayscale mask
+// image can scale the mix per pixel. The blend is not a pass of its own, it is done where the
+// filter writes its output (see run_pipeline), reading the source that is still there.
+// Masks are read a row at a time into one byte per pixel and summarised in blocks, so the parts
+// of the image a mask leaves alone are copied rather than filtered and blended.
+
+// libaries
+#include "filter_lib.h"
+#include <iostream>
+#include <algorithm>
+
+// a percentage as 256ths, 100 is 256 so a full mix gives back the filtered pixel exactly
+int mix_weight(int percent) {
+    return (std::clamp(percent, 0, 100) * 256 + 50) / 100;
+}
+
+bool blends(const filter_params& params) {
+    return params.mix < 100 || params.mask != NULL;
+}
+
+// out may be either of the other two, every byte is read before it is written
+void blend_row(Pixeldata* out, const Pixeldata* filtered, const Pixeldata* source, int width, int weight, const BYTE* mask) {
+    BYTE* out_bytes = reinterpret_cast<BYTE*>(out);
+    const BYTE* filtered_bytes = reinterpret_cast<const BYTE*>(filtered);
+    const BYTE* source_bytes = reinterpret_cast<const BYTE*>(source);
+
+    if (mask == NULL) {
+        // the same weight for every byte, a straight loop the compiler vectorises in 16 bit lanes
+        uint16_t keep = 256 - weight;
+        for (int i = 0; i < width * 3; i++) {
+            out_bytes[i] = (uint16_t)(source_bytes[i] * keep + filtered_bytes[i] * weight + 128) >> 8;
+        }
+        return;
+    }
+    for (int x = 0; x < width; x++) {
+        // 0 - 255 to 0 - 256, then scaled by the mix
+        int pixel_weight = ((mask[x] + (mask[x] >> 7)) * weight) >> 8;
+        int keep = 256 - pixel_weight;
+        for (int c = 0; c < 3; c++) {
+            int i = x * 3 + c;
+            out_bytes[i] = (source_bytes[i] * keep + filtered_bytes[i] * pixel_weight + 128) >> 8;
+        }
+    }
+}
+
+// like copy_block, but each filtered pixel is blended with the source pixel at the same place
+// in the output, which may be the source itself
+void blend_block(const ImageDetails& filtered, int from_x, int from_y, const ImageDetails& source, ImageDetails& to, int to_x, int to_y, int width, int height, const filter_params& params) {
+    int weight = mix_weight(params.mix);
+    for (int y = 0; y < height; y++) {
+        const BYTE* mask = params.mask == NULL ? NULL : params.mask->values.data() + (size_t)(to_y + y) * params.mask->width + to_x;
+        blend_row(to.pixels[to_y + y] + to_x, filtered.pixels[from_y + y] + from_x, source.pixels[to_y + y] + to_x, width, weight, mask);
+    }
+}
+
+// whether a mix leaves a rectangle alone, changes part of it or replaces all of it, from the
+// blocks it overlaps so an edge that isn't on a block boundary can only make it partial
+mask_coverage blend_coverage(const filter_params& params, int x, int y, int width, int height) {
+    if (params.mix == 0) {
+        return MASK_EMPTY;
+    }
+    const filter_mask* mask = params.mask;
+    if (mask == NULL) {
+        return params.mix < 100 ? MASK_PARTIAL : MASK_FULL;
+    }
+    bool empty = true, full = params.mix == 100;
+    for (int block_y = y / MASK_BLOCK; block_y <= (y + height - 1) / MASK_BLOCK; block_y++) {
+        const BYTE* blocks = mask->blocks.data() + (size_t)block_y * mask->blocks_x;
+        for (int block_x = x / MASK_BLOCK; block_x <= (x + width - 1) / MASK_BLOCK; block_x++) {
+            empty = empty && blocks[block_x] == MASK_EMPTY;
+            full = full && blocks[block_x] == MASK_FULL;
+            if (!empty && !full) {
+                return MASK_PARTIAL;
+            }
+        }
+    }
+    return empty ? MASK_EMPTY : full ? MASK_FULL : MASK_PARTIAL;
+}
+
+// the mask's luma from the rows of an image
+void mask_rows(const ImageDetails& image, filter_mask& mask) {
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            BYTE* values = mask.values.data() + (size_t)y * mask.width;
+            for (int x = 0; x < mask.width; x++) {
+                const Pixeldata& pixel = image.pixels[y][x];
+                values[x] = (77 * pixel.R + 150 * pixel.G + 29 * pixel.B) >> 8;
+            }
+        }
+    });
+}
+
+// a plain 24 bit mask is read a row at a time, straight into its luma
+int stream_mask(const string& mask_path, const BitmapFileHeader& file_header, bool flip, filter_mask& mask) {
+    FILE* in_file = fopen(mask_path.c_str(), "rb");
+    if (in_file == NULL || fseek(in_file, file_header.bfOffBits, SEEK_SET) != 0) {
+        if (in_file != NULL) fclose(in_file);
+        return 1;
+    }
+    int padding = (4 - (mask.width * 3) % 4) % 4;
+    std::vector<Pixeldata> row(mask.width + 1);
+    for (int y = 0; y < mask.height; y++) {
+        if (fread(row.data(), 1, (size_t)mask.width * 3 + padding, in_file) != (size_t)mask.width * 3 + padding) {
+            fclose(in_file);
+            return 1;
+        }
+        BYTE* values = mask.values.data() + (size_t)(flip ? mask.height - 1 - y : y) * mask.width;
+        for (int x = 0; x < mask.width; x++) {
+            values[x] = (77 * row[x].R + 150 * row[x].G + 29 * row[x].B) >> 8;
+        }
+    }
+    fclose(in_file);
+    return 0;
+}
+
+// read a mask for an image with the given header, its luma in the same row order as the image
+int load_mask(const string& mask_path, const BitmapInfoHeader& info_header, filter_mask& mask) {
+    BitmapFileHeader mask_file_header;
+    BitmapInfoHeader mask_info_header;
+    int headers = read_bmp_headers(mask_path, mask_file_header, mask_info_header);
+    ImageDetails image = {0, 0, NULL};
+    // anything but a plain 24 bit bmp, a palettised one or another format, is decoded whole
+    if (headers == 2 && check_and_read_file(mask_path, image, mask_file_header, mask_info_header) != 0) {
+        headers = 1;
+    }
+    if (headers == 1) {
+        std::cerr << "Error: Invalid mask file " << mask_path << std::endl;
+        return 1;
+    }
+    int width = mask_info_header.biWidth;
+    int height = abs(mask_info_header.biHeight);
+    if (width != info_header.biWidth || height != abs(info_header.biHeight)) {
+        std::cerr << "Error: The mask is " << width << "x" << height << " but the image is " << info_header.biWidth << "x" << abs(info_header.biHeight) << std::endl;
+        freeImage(image);
+        return 1;
+    }
+    // one file top down and the other bottom up
+    bool flip = (mask_info_header.biHeight < 0) != (info_header.biHeight < 0);
+
+    mask.width = width;
+    mask.height = height;
+    mask.values.resize((size_t)width * height);
+    if (image.pixels == NULL) {
+        if (stream_mask(mask_path, mask_file_header, flip, mask) != 0) {
+            std::cerr << "Error: Invalid mask file " << mask_path << std::endl;
+            return 1;
+        }
+    } else {
+        if (flip) {
+            std::reverse(image.pixels, image.pixels + image.height);
+        }
+        mask_rows(image, mask);
+        freeImage(image);
+    }
+
+    // summarise each block by whether it is all 0, all 255 or neither
+    mask.blocks_x = (width + MASK_BLOCK - 1) / MASK_BLOCK;
+    mask.blocks_y = (height + MASK_BLOCK - 1) / MASK_BLOCK;
+    mask.blocks.assign((size_t)mask.blocks_x * mask.blocks_y, MASK_PARTIAL);
+    parallel_for(0, mask.blocks_y, 0, [&](int start, int end) {
+        std::vector<BYTE> low(mask.blocks_x), high(mask.blocks_x);
+        for (int block_y = start; block_y < end; block_y++) {
+            std::fill(low.begin(), low.end(), 255);
+            std::fill(high.begin(), high.end(), 0);
+            for (int y = block_y * MASK_BLOCK; y < std::min(height, (block_y + 1) * MASK_BLOCK); y++) {
+                const BYTE* values = mask.values.data() + (size_t)y * width;
+                for (int x = 0; x < width; x++) {
+                    low[x / MASK_BLOCK] = std::min(low[x / MASK_BLOCK], values[x]);
+                    high[x / MASK_BLOCK] = std::max(high[x / MASK_BLOCK], values[x]);
+                }
+            }
+            for (int block_x = 0; block_x < mask.blocks_x; block_x++) {
+                BYTE& block = mask.blocks[(size_t)block_y * mask.blocks_x + block_x];
+                block = high[block_x] == 0 ? MASK_EMPTY : low[block_x] == 255 ? MASK_FULL : MASK_PARTIAL;
+            }
+        }
+    });
+    return 0;
+}
@@ -0,0 +1,312 @@
+// filter_overlay.cpp - compositing a logo or watermark over images
+// The overlay is read once, with its alpha if it is a 32 bit bmp, and premultiplied. The first time
+// it is drawn at a size it is resized in premultiplied floats (where averaging doesn't bleed the
+// colour of transparent pixels in) and turned into bytes: the colour to add and how much of the
+// image to keep, trimmed to the box that isn't transparent. Every later image that size reuses it,
+// and compositing is a fixed point multiply-add over the bytes of that box only.
+
+// libaries
+#include "filter_lib.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+
+// gap between the overlay and the image's edges, as a percentage of the image's smaller side
+const int OVERLAY_MARGIN = 2;
+
+// BI_BITFIELDS, and the channel masks of the byte order we composite in
+const int BMP_BITFIELDS = 3;
+const uint32_t BMP_RED_MASK = 0x00FF0000;
+const uint32_t BMP_GREEN_MASK = 0x0000FF00;
+const uint32_t BMP_BLUE_MASK = 0x000000FF;
+
+// a 32 bit bmp into B, G, R and alpha bytes top down, 2 when it isn't one
+int read_bgra_bmp(const string& path, int& width, int& height, std::vector<BYTE>& pixels) {
+    FILE* in_file = fopen(path.c_str(), "rb");
+    if (in_file == NULL) {
+        return 1;
+    }
+    std::vector<BYTE> data;
+    BYTE buffer[65536];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), in_file)) > 0) {
+        data.insert(data.end(), buffer, buffer + got);
+    }
+    fclose(in_file);
+
+    BitmapFileHeader file_header;
+    BitmapInfoHeader info_header;
+    if (data.size() < sizeof(file_header) + sizeof(info_header)) {
+        return 2;
+    }
+    memcpy(&file_header, data.data(), sizeof(file_header));
+    memcpy(&info_header, data.data() + sizeof(file_header), sizeof(info_header));
+    if (file_header.bfType != 0x4D42 || info_header.biBitCount != 32 || info_header.biWidth <= 0 || info_header.biHeight == 0) {
+        return 2;
+    }
+
+    // bitfields follow a plain info header, or are part of a bigger one, only BGRA is supported
+    bool has_alpha = info_header.biCompression == 0;
+    if (info_header.biCompression == BMP_BITFIELDS) {
+        uint32_t masks[4] = {0, 0, 0, 0};
+        size_t masks_at = sizeof(file_header) + sizeof(info_header);
+        size_t mask_count = info_header.biSize >= 56 ? 4 : 3;
+        if (data.size() < masks_at + mask_count * 4) {
+            return 1;
+        }
+        memcpy(masks, data.data() + masks_at, mask_count * 4);
+        if (masks[0] != BMP_RED_MASK || masks[1] != BMP_GREEN_MASK || masks[2] != BMP_BLUE_MASK) {
+            return 1;
+        }
+        has_alpha = masks[3] == 0xFF000000;
+    } else if (info_header.biCompression != 0) {
+        return 1;
+    }
+
+    width = info_header.biWidth;
+    height = abs(info_header.biHeight);
+    size_t size = (size_t)width * height * 4;
+    if (file_header.bfOffBits > data.size() || data.size() - file_header.bfOffBits < size) {
+        return 1;
+    }
+    pixels.resize(size);
+    for (int y = 0; y < height; y++) {
+        int from = info_header.biHeight > 0 ? height - 1 - y : y;
+        memcpy(&pixels[(size_t)y * width * 4], data.data() + file_header.bfOffBits + (size_t)from * width * 4, (size_t)width * 4);
+    }
+
+    // plain 32 bit files often leave the fourth byte 0, that means opaque rather than invisible
+    bool any_alpha = false;
+    for (size_t i = 3; i < size && has_alpha; i += 4) {
+        any_alpha = any_alpha || pixels[i] != 0;
+    }
+    if (!has_alpha || !any_alpha) {
+        for (size_t i = 3; i < size; i += 4) {
+            pixels[i] = 255;
+        }
+    }
+    return 0;
+}
+
+overlay_source* load_overlay(const string& overlay_path, overlay_position position) {
+    int width, height;
+    std::vector<BYTE> pixels;
+    int result = read_bgra_bmp(overlay_path, width, height, pixels);
+    if (result == 2) {
+        // anything else is read as an opaque image
+        ImageDetails image;
+        BitmapFileHeader file_header;
+        BitmapInfoHeader info_header;
+        result = check_and_read_file(overlay_path, image, file_header, info_header);
+        if (result == 0) {
+            width = image.width;
+            height = image.height;
+            pixels.resize((size_t)width * height * 4);
+            for (int y = 0; y < height; y++) {
+                const Pixeldata* row = image.pixels[info_header.biHeight > 0 ? height - 1 - y : y];
+                for (int x = 0; x < width; x++) {
+                    BYTE* pixel = &pixels[((size_t)y * width + x) * 4];
+                    pixel[0] = row[x].B;
+                    pixel[1] = row[x].G;
+                    pixel[2] = row[x].R;
+                    pixel[3] = 255;
+                }
+            }
+            freeImage(image);
+        }
+    }
+    if (result != 0) {
+        std::cerr << "Error: Invalid overlay file " << overlay_path << std::endl;
+        return NULL;
+    }
+
+    overlay_source* overlay = new overlay_source;
+    overlay->width = width;
+    overlay->height = height;
+    overlay->position = position;
+    overlay->pixels.resize(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        float alpha = pixels[i + 3] / 255.0f;
+        overlay->pixels[i] = pixels[i] * alpha;
+        overlay->pixels[i + 1] = pixels[i + 1] * alpha;
+        overlay->pixels[i + 2] = pixels[i + 2] * alpha;
+        overlay->pixels[i + 3] = pixels[i + 3];
+    }
+    return overlay;
+}
+
+void free_overlay(overlay_source* overlay) {
+    delete overlay;
+}
+
+// taps for resizing size samples to new_size, a tent one sample of the coarser spacing wide:
+// bilinear when growing, a weighted average of the samples covered when shrinking
+struct resize_taps {
+    int taps;
+    std::vector<int> index;
+    std::vector<float> weight;
+};
+
+resize_taps make_resize_taps(int size, int new_size) {
+    resize_taps result;
+    float scale = (float)size / new_size;
+    float support = std::max(1.0f, scale);
+    result.taps = 2 * (int)ceil(support) + 1;
+    result.index.resize((size_t)new_size * result.taps);
+    result.weight.resize(result.index.size());
+    for (int x = 0; x < new_size; x++) {
+        float centre = (x + 0.5f) * scale - 0.5f;
+        int first = (int)floor(centre - support) + 1;
+        float total = 0;
+        for (int k = 0; k < result.taps; k++) {
+            float weight = std::max(0.0f, 1 - fabsf(first + k - centre) / support);
+            result.index[(size_t)x * result.taps + k] = std::clamp(first + k, 0, size - 1);
+            result.weight[(size_t)x * result.taps + k] = weight;
+            total += weight;
+        }
+        for (int k = 0; k < result.taps; k++) {
+            result.weight[(size_t)x * result.taps + k] /= total;
+        }
+    }
+    return result;
+}
+
+// the overlay resized to width x height, then to bytes trimmed to the box with any alpha in it
+overlay_plane make_overlay_plane(const overlay_source& overlay, int width, int height) {
+    resize_taps across = make_resize_taps(overlay.width, width);
+    resize_taps down = make_resize_taps(overlay.height, height);
+
+    // across every row of the original, then down
+    std::vector<float> wide((size_t)overlay.height * width * 4);
+    parallel_for(0, overlay.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            const float* row = &overlay.pixels[(size_t)y * overlay.width * 4];
+            float* out = &wide[(size_t)y * width * 4];
+            for (int x = 0; x < width; x++) {
+                for (int k = 0; k < across.taps; k++) {
+                    const float* sample = &row[across.index[(size_t)x * across.taps + k] * 4];
+                    float weight = across.weight[(size_t)x * across.taps + k];
+                    for (int c = 0; c < 4; c++) {
+                        out[x * 4 + c] += sample[c] * weight;
+                    }
+                }
+            }
+        }
+    });
+    std::vector<float> resized((size_t)height * width * 4);
+    parallel_for(0, height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            float* out = &resized[(size_t)y * width * 4];
+            for (int k = 0; k < down.taps; k++) {
+                const float* row = &wide[(size_t)down.index[(size_t)y * down.taps + k] * width * 4];
+                float weight = down.weight[(size_t)y * down.taps + k];
+                for (int i = 0; i < width * 4; i++) {
+                    out[i] += row[i] * weight;
+                }
+            }
+        }
+    });
+
+    // the box that isn't fully transparent once rounded to bytes
+    int x0 = width, y0 = height, x1 = 0, y1 = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (resized[((size_t)y * width + x) * 4 + 3] >= 0.5f) {
+                x0 = std::min(x0, x);
+                y0 = std::min(y0, y);
+                x1 = std::max(x1, x + 1);
+                y1 = std::max(y1, y + 1);
+            }
+        }
+    }
+    overlay_plane plane;
+    if (x1 <= x0) {
+        return plane;
+    }
+    plane.x = x0;
+    plane.y = y0;
+    plane.width = x1 - x0;
+    plane.height = y1 - y0;
+    plane.colour.resize((size_t)plane.width * plane.height * 3);
+    plane.keep.resize(plane.colour.size());
+    for (int y = 0; y < plane.height; y++) {
+        for (int x = 0; x < plane.width; x++) {
+            const float* pixel = &resized[((size_t)(y0 + y) * width + x0 + x) * 4];
+            int alpha = std::clamp((int)lroundf(pixel[3]), 0, 255);
+            size_t i = ((size_t)y * plane.width + x) * 3;
+            for (int c = 0; c < 3; c++) {
+                // premultiplied colour can't be more than its alpha, so the sum never passes 255
+                plane.colour[i + c] = std::clamp((int)lroundf(pixel[c]), 0, alpha);
+                plane.keep[i + c] = 255 - alpha;
+            }
+        }
+    }
+    return plane;
+}
+
+// made the first time each size is asked for, images of one size in a batch share it
+// the plane is made outside the lock, its parallel_for can run another image's task on this thread
+// and that may want a plane too, so two threads can make the same size and the first one is kept
+const overlay_plane& overlay_at_size(const overlay_source& overlay, int width, int height) {
+    {
+        std::lock_guard<std::mutex> guard(overlay.lock);
+        auto found = overlay.sizes.find({width, height});
+        if (found != overlay.sizes.end()) {
+            return found->second;
+        }
+    }
+    overlay_plane plane = make_overlay_plane(overlay, width, height);
+    std::lock_guard<std::mutex> guard(overlay.lock);
+    return overlay.sizes.emplace(std::make_pair(width, height), std::move(plane)).first->second;
+}
+
+// out = colour + out * keep / 255 for every byte, rounded, a straight loop the compiler
+// vectorises in 16 bit lanes
+void composite_row(BYTE* out, const BYTE* colour, const BYTE* keep, int count) {
+    for (int i = 0; i < count; i++) {
+        uint16_t scaled = out[i] * keep[i] + 128;
+        out[i] = colour[i] + ((scaled + (scaled >> 8)) >> 8);
+    }
+}
+
+// the strength is the overlay's width as a percentage of the image's, it keeps its aspect ratio
+void applyOverlay(ImageDetails& image, const overlay_source& overlay, int filter_strength, bool top_down) {
+    int width = std::max(1, image.width * std::clamp(filter_strength, 1, 100) / 100);
+    int height = std::max(1, (int)lround((double)width * overlay.height / overlay.width));
+    if (height > image.height) {
+        height = image.height;
+        width = std::clamp((int)lround((double)height * overlay.width / overlay.height), 1, image.width);
+    }
+
+    int margin = std::min(image.width, image.height) * OVERLAY_MARGIN / 100;
+    int left = image.width - width - margin;
+    int top = image.height - height - margin;
+    if (overlay.position == OVERLAY_TOP_LEFT || overlay.position == OVERLAY_BOTTOM_LEFT) {
+        left = margin;
+    } else if (overlay.position == OVERLAY_CENTRE) {
+        left = (image.width - width) / 2;
+    }
+    if (overlay.position == OVERLAY_TOP_LEFT || overlay.position == OVERLAY_TOP_RIGHT) {
+        top = margin;
+    } else if (overlay.position == OVERLAY_CENTRE) {
+        top = (image.height - height) / 2;
+    }
+    left = std::clamp(left, 0, image.width - width);
+    top = std::clamp(top, 0, image.height - height);
+
+    // only the rows and columns of the overlay's box are touched
+    const overlay_plane& plane = overlay_at_size(overlay, width, height);
+    parallel_for(0, plane.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            // overlay rows are top down, the image's are bottom up unless its height was negative
+            int row = top + plane.y + y;
+            if (!top_down) {
+                row = image.height - 1 - row;
+            }
+            size_t offset = (size_t)y * plane.width * 3;
+            composite_row(reinterpret_cast<BYTE*>(image.pixels[row] + left + plane.x), &plane.colour[offset], &plane.keep[offset], plane.width * 3);
+        }
+    });
+}
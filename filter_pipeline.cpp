@@ -0,0 +1,357 @@
+// filter_pipeline.cpp - scheduling chains of filters
+// A chain of filters is a pipeline of stages, each reading the pixels within its halo of every
+// output coordinate. Rather than running every filter over the whole image in turn, stages are
+// grouped so one sweep over the image does several of them:
+// - point and row filters run inline, on each row as the stage before makes it
+// - stencils run per output tile in a small scratch image, grown by the halos of the stencils in
+//   the group so the tile's own pixels come out the same as filtering the whole image
+// - filters that read the whole image, and stencils whose margin would cost more than the tile,
+//   run at the root over the whole image between groups
+// So a chain like blur, sharpen, edge detection runs as one cache sized pass instead of three.
+// A mix with the source is done as the last group writes its output: a tile as it is copied out,
+// a row as it comes out of the inline stages. When the last group is the only one its input is
+// still the source, otherwise one copy of the source is kept for it. Tiles and rows a mask leaves
+// alone are not filtered at all, and a stencil too wide to tile the whole image is tiled over just
+// the parts the mask covers when that is fewer pixels, so the cost follows the mask's coverage.
+
+// libaries
+#include "filter_lib.h"
+#include "filter_internal.h"
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+
+// smallest tile the margin grows by at most PIPELINE_MAX_RECOMPUTE times, 0 when none does
+int choose_tile(int margin, bool full_width) {
+    for (int tile = PIPELINE_TILE; tile <= PIPELINE_MAX_TILE; tile *= 2) {
+        float grown = (float)(tile + 2 * margin) / tile;
+        // bands only grow in height
+        if (!full_width) grown *= grown;
+        if (grown <= PIPELINE_MAX_RECOMPUTE) {
+            return tile;
+        }
+    }
+    return 0;
+}
+
+// check the filters and pick a schedule for each, 1 for a filter that can't be in a pipeline
+int build_pipeline(const int filter_ids[], const int filter_strengths[], int count, filter_pipeline& pipeline) {
+    pipeline.stages.clear();
+    pipeline.groups.clear();
+    bool open = false;
+
+    for (int i = 0; i < count; i++) {
+        const filter_info* filter = find_filter(filter_ids[i]);
+        // ascii and the temporal filters have nothing to apply to a single image
+        if (filter == NULL || filter->apply == NULL) {
+            return 1;
+        }
+        pipeline_stage stage;
+        stage.filter_id = filter_ids[i];
+        stage.strength = filter_strengths[i];
+        stage.halo = filter->halo(stage.strength);
+        pipeline_group* group = open ? &pipeline.groups.back() : NULL;
+
+        if (filter->kind == FILTER_HEADER_ONLY || filter->kind == FILTER_GLOBAL) {
+            stage.schedule = SCHEDULE_ROOT;
+        } else if (filter->apply_row != NULL) {
+            stage.schedule = SCHEDULE_INLINE;
+            if (group != NULL && filter->kind == FILTER_ROW && !group->full_width) {
+                group->full_width = true;
+                if (group->schedule == SCHEDULE_TILE) {
+                    group->tile = choose_tile(group->margin, true);
+                }
+            }
+        } else {
+            stage.schedule = SCHEDULE_TILE;
+            int tile = group == NULL ? 0 : choose_tile(group->margin + stage.halo, group->full_width);
+            if (tile != 0) {
+                group->margin += stage.halo;
+                group->tile = tile;
+                group->schedule = SCHEDULE_TILE;
+            } else {
+                // too big a margin to add to the open group, start a group of its own if it fits
+                open = false;
+                group = NULL;
+                if (choose_tile(stage.halo, false) == 0) {
+                    stage.schedule = SCHEDULE_ROOT;
+                }
+            }
+        }
+
+        if (stage.schedule == SCHEDULE_ROOT) {
+            open = false;
+            pipeline.groups.push_back({i, 1, SCHEDULE_ROOT, 0, 0, false});
+        } else if (group != NULL) {
+            group->stage_count++;
+        } else {
+            bool full_width = filter->kind == FILTER_ROW;
+            int margin = stage.schedule == SCHEDULE_TILE ? stage.halo : 0;
+            pipeline.groups.push_back({i, 1, stage.schedule, margin, choose_tile(margin, full_width), full_width});
+            open = true;
+        }
+        pipeline.stages.push_back(stage);
+    }
+    return 0;
+}
+
+// a stage on the rows of an image, or on a whole image, on this thread's share of the work
+void run_stage(ImageDetails& image, const pipeline_stage& stage, const filter_params& params) {
+    const filter_info* filter = find_filter(stage.filter_id);
+    filter_params stage_params = params;
+    stage_params.strength = stage.strength;
+    // the stages themselves run unmixed, only the pipeline's final write blends
+    stage_params.mix = 100;
+    stage_params.mask = NULL;
+    if (stage.schedule == SCHEDULE_INLINE) {
+        for (int y = 0; y < image.height; y++) {
+            filter->apply_row(image.pixels[y], image.width, stage_params);
+        }
+    } else {
+        filter->apply(image, stage_params);
+    }
+}
+
+// every stage of the group on each tile in turn, the tile's inner pixels go to the output,
+// blended with the source when there is one
+void run_tiled_group(ImageDetails& image, const filter_pipeline& pipeline, const pipeline_group& group, const filter_params& params, const ImageDetails* source) {
+    int tile_width = group.full_width ? image.width : group.tile;
+    int tiles_x = (image.width + tile_width - 1) / tile_width;
+    int tiles_y = (image.height + group.tile - 1) / group.tile;
+    ImageDetails output;
+    if (create_image(output, image.width, image.height) != 0) {
+        return;
+    }
+
+    parallel_for(0, tiles_x * tiles_y, 1, [&](int first, int last) {
+        // the tiles are the parallelism, the filters run straight through on this thread
+        serial_scope serial;
+        ImageDetails scratch;
+        create_image(scratch, std::min(image.width, tile_width + 2 * group.margin), std::min(image.height, group.tile + 2 * group.margin));
+        for (int i = first; i < last && !filter_cancelled(); i++) {
+            int x0 = (i % tiles_x) * tile_width;
+            int y0 = (i / tiles_x) * group.tile;
+            int x1 = std::min(image.width, x0 + tile_width);
+            int y1 = std::min(image.height, y0 + group.tile);
+            int margin_x0 = std::max(0, x0 - group.margin);
+            int margin_y0 = std::max(0, y0 - group.margin);
+
+            // with a mix, tiles it leaves alone keep the source and aren't filtered at all
+            mask_coverage coverage = source == NULL ? MASK_FULL : blend_coverage(params, x0, y0, x1 - x0, y1 - y0);
+            if (coverage == MASK_EMPTY) {
+                copy_block(*source, x0, y0, output, x0, y0, x1 - x0, y1 - y0);
+                continue;
+            }
+
+            // a view of the scratch the size of this tile and its margin
+            ImageDetails part = scratch;
+            part.width = std::min(image.width, x1 + group.margin) - margin_x0;
+            part.height = std::min(image.height, y1 + group.margin) - margin_y0;
+            copy_block(image, margin_x0, margin_y0, part, 0, 0, part.width, part.height);
+            for (int s = group.first_stage; s < group.first_stage + group.stage_count; s++) {
+                run_stage(part, pipeline.stages[s], params);
+            }
+            if (coverage == MASK_PARTIAL) {
+                blend_block(part, x0 - margin_x0, y0 - margin_y0, *source, output, x0, y0, x1 - x0, y1 - y0, params);
+            } else {
+                copy_block(part, x0 - margin_x0, y0 - margin_y0, output, x0, y0, x1 - x0, y1 - y0);
+            }
+        }
+        freeImage(scratch);
+    });
+
+    freeImage(image);
+    image = output;
+}
+
+// the inline stages on each row in a buffer, the row is then blended from the buffer and the source
+void run_inline_blended(ImageDetails& image, const filter_pipeline& pipeline, const pipeline_group& group, const filter_params& params, const ImageDetails& source) {
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        ImageDetails row;
+        if (create_image(row, image.width, 1) != 0) {
+            return;
+        }
+        for (int y = start; y < end; y++) {
+            mask_coverage coverage = blend_coverage(params, 0, y, image.width, 1);
+            if (coverage == MASK_EMPTY) {
+                if (source.pixels != image.pixels) {
+                    memcpy(image.pixels[y], source.pixels[y], sizeof(Pixeldata) * image.width);
+                }
+                continue;
+            }
+            // a row the mix replaces whole is filtered where it is
+            ImageDetails filtered = row;
+            if (coverage == MASK_FULL) {
+                filtered.pixels = image.pixels + y;
+            } else {
+                memcpy(row.pixels[0], image.pixels[y], sizeof(Pixeldata) * image.width);
+            }
+            for (int s = group.first_stage; s < group.first_stage + group.stage_count; s++) {
+                run_stage(filtered, pipeline.stages[s], params);
+            }
+            if (coverage == MASK_PARTIAL) {
+                blend_block(row, 0, 0, source, image, 0, y, image.width, 1, params);
+            }
+        }
+        freeImage(row);
+    });
+}
+
+// for a stencil too wide to tile the whole image, the tile size that filters only the tiles a mix
+// changes in the fewest pixels, 0 when filtering the whole image is still cheaper
+int choose_masked_tile(const ImageDetails& image, int halo, const filter_params& params) {
+    int best = 0;
+    double best_pixels = (double)image.width * image.height;
+    for (int tile = PIPELINE_TILE; tile <= PIPELINE_MAX_TILE; tile *= 2) {
+        double pixels = 0;
+        for (int y0 = 0; y0 < image.height; y0 += tile) {
+            for (int x0 = 0; x0 < image.width; x0 += tile) {
+                int x1 = std::min(image.width, x0 + tile);
+                int y1 = std::min(image.height, y0 + tile);
+                if (blend_coverage(params, x0, y0, x1 - x0, y1 - y0) != MASK_EMPTY) {
+                    pixels += (double)(std::min(image.width, x1 + halo) - std::max(0, x0 - halo)) * (std::min(image.height, y1 + halo) - std::max(0, y0 - halo));
+                }
+            }
+        }
+        if (pixels < best_pixels) {
+            best_pixels = pixels;
+            best = tile;
+        }
+    }
+    return best;
+}
+
+// 0 when done, 1 for a mask the wrong size or no memory for a copy of the source, 2 when cancelled
+// part way, leaving the image partly filtered
+int run_pipeline(ImageDetails& image, const filter_pipeline& pipeline, const filter_params& params) {
+    if (params.mask != NULL && (params.mask->width != image.width || params.mask->height != image.height)) {
+        return 1;
+    }
+    cancel_scope scope(params.cancel);
+    priority_scope priority(params.priority);
+
+    bool blend = blends(params) && !pipeline.groups.empty();
+    const pipeline_group* last = blend ? &pipeline.groups.back() : NULL;
+    // the last group's stencil tiled over only what the mix changes, when that is cheaper
+    pipeline_group masked = {0, 0, SCHEDULE_ROOT, 0, 0, false};
+    if (last != NULL && last->schedule == SCHEDULE_ROOT && find_filter(pipeline.stages[last->first_stage].filter_id)->kind == FILTER_STENCIL) {
+        int halo = pipeline.stages[last->first_stage].halo;
+        masked = {last->first_stage, 1, SCHEDULE_TILE, halo, choose_masked_tile(image, halo, params), false};
+        if (masked.tile == 0) {
+            masked.schedule = SCHEDULE_ROOT;
+        }
+    }
+    // a single tiled or inline group reads the source until it writes, anything else needs a copy
+    ImageDetails source = image;
+    bool copied = blend && (pipeline.groups.size() > 1 || (last->schedule == SCHEDULE_ROOT && masked.schedule == SCHEDULE_ROOT));
+    if (copied) {
+        if (create_image(source, image.width, image.height) != 0) {
+            return 1;
+        }
+        copy_block(image, 0, 0, source, 0, 0, image.width, image.height);
+    }
+
+    for (const pipeline_group& group : pipeline.groups) {
+        if (filter_cancelled()) {
+            break;
+        }
+        bool mixed = &group == last;
+        if (mixed && blend_coverage(params, 0, 0, image.width, image.height) == MASK_EMPTY) {
+            // nothing of the last group's result would be kept
+            if (copied) {
+                copy_block(source, 0, 0, image, 0, 0, image.width, image.height);
+            }
+        } else if (mixed && masked.schedule == SCHEDULE_TILE) {
+            run_tiled_group(image, pipeline, masked, params, &source);
+        } else if (group.schedule == SCHEDULE_ROOT) {
+            const pipeline_stage& stage = pipeline.stages[group.first_stage];
+            filter_params root_params = params;
+            root_params.strength = stage.strength;
+            root_params.mix = 100;
+            root_params.mask = NULL;
+            apply_filter(image, stage.filter_id, root_params);
+            // a whole image filter has no output write of its own to blend in
+            if (mixed && !filter_cancelled()) {
+                parallel_for(0, image.height, 0, [&](int start, int end) {
+                    blend_block(image, 0, start, source, image, 0, start, image.width, end - start, params);
+                });
+            }
+        } else if (mixed && group.schedule == SCHEDULE_INLINE) {
+            run_inline_blended(image, pipeline, group, params, source);
+        } else if (group.schedule == SCHEDULE_INLINE) {
+            // point and row filters only, every stage on a row while it is in cache
+            parallel_for(0, image.height, 0, [&](int start, int end) {
+                ImageDetails rows = image;
+                rows.pixels = image.pixels + start;
+                rows.height = end - start;
+                for (int s = group.first_stage; s < group.first_stage + group.stage_count; s++) {
+                    run_stage(rows, pipeline.stages[s], params);
+                }
+            });
+        } else {
+            run_tiled_group(image, pipeline, group, params, mixed ? &source : NULL);
+        }
+    }
+    if (copied) {
+        freeImage(source);
+    }
+    return filter_cancelled() ? 2 : 0;
+}
+
+// the stages with where each is computed, for example "Gaussian Blur (tile 64) > Grayscale (inline)"
+string describe_pipeline(const filter_pipeline& pipeline) {
+    string description;
+    for (const pipeline_group& group : pipeline.groups) {
+        for (int s = group.first_stage; s < group.first_stage + group.stage_count; s++) {
+            const pipeline_stage& stage = pipeline.stages[s];
+            if (!description.empty()) description += " > ";
+            description += find_filter(stage.filter_id)->name;
+            if (stage.schedule == SCHEDULE_ROOT) {
+                description += " (root)";
+            } else if (stage.schedule == SCHEDULE_INLINE) {
+                description += " (inline)";
+            } else {
+                description += (group.full_width ? " (rows " : " (tile ") + std::to_string(group.tile) + ")";
+            }
+        }
+    }
+    return description;
+}
+
+// run the chain on the loaded image and save it as <name>_<filter>_<filter>....bmp
+int run_chain_mode(program_states& states, ImageDetails& image, const BitmapFileHeader& file_header, const BitmapInfoHeader& info_header, const std::vector<int>& filter_ids, const std::vector<int>& filter_strengths) {
+    filter_pipeline pipeline;
+    if (build_pipeline(filter_ids.data(), filter_strengths.data(), filter_ids.size(), pipeline) != 0) {
+        std::cerr << "Error: Invalid filter type" << std::endl;
+        return 1;
+    }
+    std::cout << "Schedule: " << describe_pipeline(pipeline) << std::endl;
+
+    cancel_token cancel;
+    if (states.timeout_ms > 0) {
+        set_deadline(cancel, states.timeout_ms);
+    }
+    filter_params params;
+    params.cancel = &cancel;
+    params.priority = states.priority;
+    params.quality = states.quality;
+    params.mix = states.mix;
+    params.mask = states.mask.values.empty() ? NULL : &states.mask;
+    params.overlay = states.overlay;
+    params.top_down = info_header.biHeight < 0;
+    int result = run_pipeline(image, pipeline, params);
+    if (result == 1) {
+        std::cerr << "Error: Could not run the chain, the mask doesn't match the image or memory ran out" << std::endl;
+        return 1;
+    } else if (result == 2) {
+        std::cerr << "Error: Timed out after " << states.timeout_ms << "ms, no output written" << std::endl;
+        return 2;
+    }
+
+    string output_file = strip_extension(get_filename(states.file_path));
+    for (int filter_id : filter_ids) {
+        output_file += "_" + find_filter(filter_id)->name;
+    }
+    save_filter_output(find_filter(filter_ids.back()), output_file + ".bmp", image, states.file_path, file_header, info_header);
+    return 0;
+}
@@ -0,0 +1,411 @@
+// filter_pyramid.cpp - filters that work through image pyramids
+// A wide blur at full resolution reads hundreds of pixels for every pixel. Wide Blur instead
+// averages the image down in one pass to blocks small enough that the blur still to do there is
+// a few pixels, blurs that with a small gaussian and interpolates it back up, so the work is about
+// two passes over the image whatever the radius. The exact tier keeps the full resolution gaussian
+// as the reference.
+// Clarity boosts detail at several scales at once through a laplacian pyramid. Levels are reduced
+// and expanded in bands of rows, each band filtering only the rows it reads.
+
+// libaries
+#include "filter_lib.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+
+// the least blur to leave for the reduced image, in its own pixels, more keeps more levels of
+// detail for the interpolation to get right
+const float PYRAMID_FAST_RESIDUAL = 1.0f;
+const float PYRAMID_BALANCED_RESIDUAL = 1.5f;
+
+// a reduced image needs this many pixels across for the interpolation to have something to work with
+const int PYRAMID_MIN_SIZE = 4;
+
+// laplacian levels clarity boosts, finest first, and how much of the strength each gets, the
+// finest least so noise isn't what stands out
+const int DETAIL_LEVELS = 6;
+const float DETAIL_WEIGHTS[DETAIL_LEVELS] = {0.3f, 0.6f, 1.0f, 1.0f, 0.8f, 0.6f};
+
+// smallest size a level is reduced from
+const int DETAIL_MIN_SIZE = 8;
+
+// normalised gaussian weights out to 3 sigma
+std::vector<float> gaussian_kernel(float sigma) {
+    int radius = std::max(1, (int)ceil(3 * sigma));
+    std::vector<float> kernel(2 * radius + 1);
+    float total = 0;
+    for (int i = -radius; i <= radius; i++) {
+        kernel[i + radius] = exp(-(i * i) / (2 * sigma * sigma));
+        total += kernel[i + radius];
+    }
+    for (float& weight : kernel) {
+        weight /= total;
+    }
+    return kernel;
+}
+
+// separable gaussian over interleaved channels, edges repeat the outermost pixel
+void gaussian_plane(std::vector<float>& plane, int width, int height, float sigma) {
+    std::vector<float> kernel = gaussian_kernel(sigma);
+    int radius = kernel.size() / 2;
+    int stride = width * 3;
+    std::vector<float> rows(plane.size());
+
+    // along the rows, from a copy padded with the edge pixels so the inner loop is straight
+    parallel_for(0, height, 0, [&](int start, int end) {
+        std::vector<float> padded((width + 2 * radius) * 3);
+        for (int y = start; y < end; y++) {
+            const float* row = &plane[(size_t)y * stride];
+            for (int x = 0; x < width + 2 * radius; x++) {
+                int source = std::clamp(x - radius, 0, width - 1);
+                memcpy(&padded[x * 3], &row[source * 3], 3 * sizeof(float));
+            }
+            float* out = &rows[(size_t)y * stride];
+            std::fill(out, out + stride, 0.0f);
+            for (int k = 0; k <= 2 * radius; k++) {
+                const float* taps = &padded[k * 3];
+                for (int i = 0; i < stride; i++) {
+                    out[i] += taps[i] * kernel[k];
+                }
+            }
+        }
+    });
+
+    // down the columns, a whole row of the kernel at a time
+    parallel_for(0, height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            float* out = &plane[(size_t)y * stride];
+            std::fill(out, out + stride, 0.0f);
+            for (int k = -radius; k <= radius; k++) {
+                const float* taps = &rows[(size_t)std::clamp(y + k, 0, height - 1) * stride];
+                for (int i = 0; i < stride; i++) {
+                    out[i] += taps[i] * kernel[k + radius];
+                }
+            }
+        }
+    });
+}
+
+// the size of block to average down to, the largest power of 2 that leaves at least the residual
+// blur to do on the reduced image, 1 when even 2x2 blocks would blur too much
+int pyramid_block(float sigma, int width, int height, filter_quality quality) {
+    if (quality == QUALITY_EXACT) return 1;
+    float residual = quality == QUALITY_FAST ? PYRAMID_FAST_RESIDUAL : PYRAMID_BALANCED_RESIDUAL;
+    int block = 1;
+    for (int next = 2; width / next >= PYRAMID_MIN_SIZE && height / next >= PYRAMID_MIN_SIZE; next *= 2) {
+        // a block average blurs by (block^2 - 1) / 12, linear interpolation by block^2 / 6 more,
+        // the cubic reproduces quadratics so adds none
+        float variance = sigma * sigma - (next * next - 1) / 12.0f;
+        if (quality == QUALITY_FAST) variance -= next * next / 6.0f;
+        if (variance <= 0 || sqrt(variance) / next < residual) break;
+        block = next;
+    }
+    return block;
+}
+
+// the block averages, one pass over the image whatever the block size. The image is taken as
+// going on past its edges with its edge pixels, as the full size gaussian sees it, so blocks that
+// run over the edge and pad blocks either side all average that
+void reduce_blocks(const ImageDetails& image, int block, int pad, std::vector<float>& reduced, int& reduced_width, int& reduced_height) {
+    reduced_width = (image.width + block - 1) / block + 2 * pad;
+    reduced_height = (image.height + block - 1) / block + 2 * pad;
+    reduced.assign((size_t)reduced_width * reduced_height * 3, 0.0f);
+    float count = block * block;
+
+    parallel_for(0, reduced_height, 0, [&](int start, int end) {
+        std::vector<int> sums(image.width * 3);
+        for (int by = start; by < end; by++) {
+            // the block's rows summed, then across each block's columns
+            std::fill(sums.begin(), sums.end(), 0);
+            for (int y = (by - pad) * block; y < (by - pad + 1) * block; y++) {
+                const BYTE* row = reinterpret_cast<const BYTE*>(image.pixels[std::clamp(y, 0, image.height - 1)]);
+                for (int i = 0; i < image.width * 3; i++) {
+                    sums[i] += row[i];
+                }
+            }
+            float* out = &reduced[(size_t)by * reduced_width * 3];
+            for (int bx = 0; bx < reduced_width; bx++) {
+                int total[3] = {0, 0, 0};
+                for (int x = (bx - pad) * block; x < (bx - pad + 1) * block; x++) {
+                    int column = std::clamp(x, 0, image.width - 1) * 3;
+                    total[0] += sums[column];
+                    total[1] += sums[column + 1];
+                    total[2] += sums[column + 2];
+                }
+                for (int c = 0; c < 3; c++) {
+                    out[bx * 3 + c] = total[c] / count;
+                }
+            }
+        }
+    });
+}
+
+// where each full size coordinate falls between the reduced samples, as taps and weights
+struct upsample_taps {
+    int taps;
+    std::vector<int> index;
+    std::vector<float> weight;
+};
+
+upsample_taps make_taps(int size, int reduced_size, int block, int pad, bool cubic) {
+    upsample_taps result;
+    result.taps = cubic ? 4 : 2;
+    result.index.resize((size_t)size * result.taps);
+    result.weight.resize(result.index.size());
+    for (int x = 0; x < size; x++) {
+        // the reduced samples sit at the centres of their blocks, after the pad
+        float position = (x + 0.5f) / block - 0.5f + pad;
+        int base = floor(position);
+        float t = position - base;
+        float weights[4];
+        if (cubic) {
+            // catmull-rom
+            weights[0] = (-t * t * t + 2 * t * t - t) / 2;
+            weights[1] = (3 * t * t * t - 5 * t * t + 2) / 2;
+            weights[2] = (-3 * t * t * t + 4 * t * t + t) / 2;
+            weights[3] = (t * t * t - t * t) / 2;
+            base -= 1;
+        } else {
+            weights[0] = 1 - t;
+            weights[1] = t;
+        }
+        for (int k = 0; k < result.taps; k++) {
+            result.index[(size_t)x * result.taps + k] = std::clamp(base + k, 0, reduced_size - 1);
+            result.weight[(size_t)x * result.taps + k] = weights[k];
+        }
+    }
+    return result;
+}
+
+// interpolate the reduced image back up to the full image, across then down
+void upsample_blocks(const std::vector<float>& reduced, int reduced_width, int reduced_height, int block, int pad, bool cubic, ImageDetails& image) {
+    upsample_taps across = make_taps(image.width, reduced_width, block, pad, cubic);
+    upsample_taps down = make_taps(image.height, reduced_height, block, pad, cubic);
+    int stride = image.width * 3;
+
+    // every reduced row at full width, only a block's worth of the image's rows
+    std::vector<float> wide((size_t)reduced_height * stride);
+    parallel_for(0, reduced_height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            const float* row = &reduced[(size_t)y * reduced_width * 3];
+            float* out = &wide[(size_t)y * stride];
+            for (int x = 0; x < image.width; x++) {
+                float sum[3] = {0, 0, 0};
+                for (int k = 0; k < across.taps; k++) {
+                    const float* sample = &row[across.index[(size_t)x * across.taps + k] * 3];
+                    float weight = across.weight[(size_t)x * across.taps + k];
+                    sum[0] += sample[0] * weight;
+                    sum[1] += sample[1] * weight;
+                    sum[2] += sample[2] * weight;
+                }
+                memcpy(&out[x * 3], sum, sizeof(sum));
+            }
+        }
+    });
+
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        std::vector<float> sum(stride);
+        for (int y = start; y < end; y++) {
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            for (int k = 0; k < down.taps; k++) {
+                const float* row = &wide[(size_t)down.index[(size_t)y * down.taps + k] * stride];
+                float weight = down.weight[(size_t)y * down.taps + k];
+                for (int i = 0; i < stride; i++) {
+                    sum[i] += row[i] * weight;
+                }
+            }
+            BYTE* out = reinterpret_cast<BYTE*>(image.pixels[y]);
+            for (int i = 0; i < stride; i++) {
+                out[i] = std::clamp(sum[i] + 0.5f, 0.0f, 255.0f);
+            }
+        }
+    });
+}
+
+// gaussian blur with a standard deviation of sigma pixels
+void applyWideBlur(ImageDetails& image, float sigma, filter_quality quality) {
+    int block = pyramid_block(sigma, image.width, image.height, quality);
+    int stride = image.width * 3;
+
+    if (block == 1) {
+        // the reference, the whole gaussian at full resolution
+        std::vector<float> plane((size_t)image.height * stride);
+        for (int y = 0; y < image.height; y++) {
+            const BYTE* row = reinterpret_cast<const BYTE*>(image.pixels[y]);
+            std::copy(row, row + stride, &plane[(size_t)y * stride]);
+        }
+        gaussian_plane(plane, image.width, image.height, sigma);
+        parallel_for(0, image.height, 0, [&](int start, int end) {
+            for (int y = start; y < end; y++) {
+                BYTE* row = reinterpret_cast<BYTE*>(image.pixels[y]);
+                for (int i = 0; i < stride; i++) {
+                    row[i] = std::clamp(plane[(size_t)y * stride + i] + 0.5f, 0.0f, 255.0f);
+                }
+            }
+        });
+        return;
+    }
+
+    // what the block average and interpolation haven't done already, in reduced pixels
+    float variance = sigma * sigma - (block * block - 1) / 12.0f;
+    if (quality == QUALITY_FAST) variance -= block * block / 6.0f;
+    float residual = sqrt(variance) / block;
+    // enough of the edge around the image for the gaussian's reach and the interpolation's taps
+    int pad = ceil(3 * residual) + 2;
+
+    std::vector<float> reduced;
+    int reduced_width, reduced_height;
+    reduce_blocks(image, block, pad, reduced, reduced_width, reduced_height);
+    gaussian_plane(reduced, reduced_width, reduced_height, residual);
+    upsample_blocks(reduced, reduced_width, reduced_height, block, pad, quality != QUALITY_FAST, image);
+}
+
+// half the size with the 5 tap binomial kernel [1 4 6 4 1] / 16 both ways, edges repeated,
+// load_row puts a row of the finer level into a buffer of width * 3 floats
+void reduce_level(int width, int height, const std::function<void(int, float*)>& load_row, pyramid_level& coarse) {
+    coarse.width = (width + 1) / 2;
+    coarse.height = (height + 1) / 2;
+    coarse.pixels.resize((size_t)coarse.width * coarse.height * 3);
+    int stride = coarse.width * 3;
+
+    parallel_for(0, coarse.height, 0, [&](int start, int end) {
+        // the finer rows this band reads, filtered and halved across
+        int first = 2 * start - 2;
+        int count = 2 * (end - 1) + 2 - first + 1;
+        std::vector<float> across((size_t)count * stride);
+        // a row with 2 pixels of its edges either side
+        std::vector<float> padded((width + 4) * 3);
+        for (int r = 0; r < count; r++) {
+            float* row = &padded[6];
+            load_row(std::clamp(first + r, 0, height - 1), row);
+            for (int i = 0; i < 6; i++) {
+                padded[i] = row[i % 3];
+                row[width * 3 + i] = row[(width - 1) * 3 + i % 3];
+            }
+            float* out = &across[(size_t)r * stride];
+            for (int x = 0; x < coarse.width; x++) {
+                for (int c = 0; c < 3; c++) {
+                    const float* tap = &row[2 * x * 3 + c];
+                    out[x * 3 + c] = (tap[-6] + 4 * tap[-3] + 6 * tap[0] + 4 * tap[3] + tap[6]) / 16;
+                }
+            }
+        }
+        for (int y = start; y < end; y++) {
+            const float* rows[5];
+            for (int k = 0; k < 5; k++) {
+                rows[k] = &across[(size_t)(2 * y - 2 + k - first) * stride];
+            }
+            float* out = &coarse.pixels[(size_t)y * stride];
+            for (int i = 0; i < stride; i++) {
+                out[i] = (rows[0][i] + 4 * rows[1][i] + 6 * rows[2][i] + 4 * rows[3][i] + rows[4][i]) / 16;
+            }
+        }
+    });
+}
+
+// back up to width x height with the same kernel, handing each row to use_row rather than
+// keeping the whole finer level
+void expand_level(const pyramid_level& coarse, int width, int height, const std::function<void(int, const float*)>& use_row) {
+    int stride = width * 3;
+
+    parallel_for(0, height, 0, [&](int start, int end) {
+        // the coarse rows this band reads, expanded across
+        int first = start / 2 - 1;
+        int count = (end - 1) / 2 + 1 - first + 1;
+        std::vector<float> across((size_t)count * stride);
+        // a coarse row with a pixel of its edges either side
+        std::vector<float> padded((coarse.width + 2) * 3);
+        for (int r = 0; r < count; r++) {
+            int source = std::clamp(first + r, 0, coarse.height - 1);
+            float* row = &padded[3];
+            memcpy(row, &coarse.pixels[(size_t)source * coarse.width * 3], coarse.width * 3 * sizeof(float));
+            for (int c = 0; c < 3; c++) {
+                padded[c] = row[c];
+                row[coarse.width * 3 + c] = row[(coarse.width - 1) * 3 + c];
+            }
+            // even pixels sit on a coarse one, odd ones halfway between two
+            float* out = &across[(size_t)r * stride];
+            for (int x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++) {
+                    const float* tap = &row[(x / 2) * 3 + c];
+                    out[x * 3 + c] = x % 2 == 0 ? (tap[-3] + 6 * tap[0] + tap[3]) / 8 : (tap[0] + tap[3]) / 2;
+                }
+            }
+        }
+        std::vector<float> row(stride);
+        for (int y = start; y < end; y++) {
+            const float* above = &across[(size_t)(y / 2 - 1 - first) * stride];
+            const float* here = above + stride;
+            const float* below = here + stride;
+            if (y % 2 == 0) {
+                for (int i = 0; i < stride; i++) {
+                    row[i] = (above[i] + 6 * here[i] + below[i]) / 8;
+                }
+            } else {
+                for (int i = 0; i < stride; i++) {
+                    row[i] = (here[i] + below[i]) / 2;
+                }
+            }
+            use_row(y, row.data());
+        }
+    });
+}
+
+// local contrast enhancement: each level of the image's laplacian pyramid is scaled by its gain,
+// the middle scales most, and the pyramid collapsed again. The laplacian levels are never stored,
+// with gains g and gaussian levels G, collapsing from the top as
+//   d[N] = (1 - g[N-1]) G[N]
+//   d[k] = (g[k] - g[k-1]) G[k] + expand(d[k+1])
+//   out  = g[0] image + expand(d[1])
+// needs one expand a level, done in place over the gaussian levels, a third of the image in floats
+void applyClarity(ImageDetails& image, int filter_strength) {
+    int levels = 0;
+    for (int width = image.width, height = image.height; levels < DETAIL_LEVELS && std::min(width, height) / 2 >= DETAIL_MIN_SIZE; levels++) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    if (levels == 0) return;
+
+    // the gaussian pyramid, the image itself is level 0
+    std::vector<pyramid_level> pyramid(levels + 1);
+    reduce_level(image.width, image.height, [&](int y, float* row) {
+        const BYTE* pixels = reinterpret_cast<const BYTE*>(image.pixels[y]);
+        std::copy(pixels, pixels + image.width * 3, row);
+    }, pyramid[1]);
+    for (int k = 1; k < levels; k++) {
+        const pyramid_level& fine = pyramid[k];
+        reduce_level(fine.width, fine.height, [&](int y, float* row) {
+            memcpy(row, &fine.pixels[(size_t)y * fine.width * 3], fine.width * 3 * sizeof(float));
+        }, pyramid[k + 1]);
+    }
+
+    // the low pass left at the top keeps a gain of 1
+    float amount = filter_strength / 50.0f;
+    float gain[DETAIL_LEVELS + 1];
+    for (int k = 0; k < levels; k++) {
+        gain[k] = 1 + amount * DETAIL_WEIGHTS[k];
+    }
+    gain[levels] = 1;
+
+    for (float& value : pyramid[levels].pixels) {
+        value *= gain[levels] - gain[levels - 1];
+    }
+    for (int k = levels - 1; k >= 1; k--) {
+        pyramid_level& level = pyramid[k];
+        float scale = gain[k] - gain[k - 1];
+        expand_level(pyramid[k + 1], level.width, level.height, [&](int y, const float* expanded) {
+            float* row = &level.pixels[(size_t)y * level.width * 3];
+            for (int i = 0; i < level.width * 3; i++) {
+                row[i] = scale * row[i] + expanded[i];
+            }
+        });
+        std::vector<float>().swap(pyramid[k + 1].pixels);
+    }
+    expand_level(pyramid[1], image.width, image.height, [&](int y, const float* expanded) {
+        BYTE* row = reinterpret_cast<BYTE*>(image.pixels[y]);
+        for (int i = 0; i < image.width * 3; i++) {
+            row[i] = std::clamp(gain[0] * row[i] + expanded[i] + 0.5f, 0.0f, 255.0f);
+        }
+    });
+}
@@ -0,0 +1,433 @@
+// filter_quantise.cpp - colour quantisation and palettised bmps
+// Reduces an image to a palette of at most 256 colours and saves it as an 8 bit bmp, a third of
+// the size of the 24 bit one. The palette comes from median cut over a sample of the pixels, or is
+// the image's own colours when it already has few enough. Pixels are mapped through a table of
+// candidate palette entries per 5 bit cell of colour space, so each pixel only measures its
+// distance to the few entries that can be nearest. Ordered dithering is optional.
+
+// libaries
+#include "filter_lib.h"
+#include <string.h>
+#include <math.h>
+#include <mutex>
+#include <algorithm>
+#include <iterator>
+
+// pixels the palette is built from, spread over the whole image
+const int QUANTISE_SAMPLES = 1 << 16;
+
+// colour space cells of the lookup table, 5 bits per channel
+const int QUANTISE_CELL_BITS = 5;
+const int QUANTISE_CELLS = 1 << (3 * QUANTISE_CELL_BITS);
+
+// 8x8 Bayer matrix for ordered dithering
+const int BAYER[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21}
+};
+
+// a range of samples and its widest channel, split in two until there are enough colours
+struct colour_box {
+    int begin;
+    int end;
+    int channel;
+    int range;
+};
+
+// palette entries worth measuring for each cell of colour space
+struct palette_lookup {
+    std::vector<int> start;           // QUANTISE_CELLS + 1 offsets into candidates
+    std::vector<BYTE> candidates;
+};
+
+inline uint32_t colour_key(const Pixeldata& pixel) {
+    return (uint32_t)pixel.R << 16 | (uint32_t)pixel.G << 8 | pixel.B;
+}
+
+inline int channel_of(const Pixeldata& pixel, int channel) {
+    return reinterpret_cast<const BYTE*>(&pixel)[channel];
+}
+
+// strength 1 - 100 to a palette of 2 - 256 colours
+int quantise_colours(int strength) {
+    return std::clamp(strength * 256 / 100, 2, 256);
+}
+
+// the image's distinct colours, sorted, or false when there are more than limit of them
+bool find_colours(const ImageDetails& image, int limit, std::vector<uint32_t>& colours) {
+    std::mutex lock;
+    std::atomic<bool> too_many{false};
+    colours.clear();
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        std::vector<uint32_t> band;
+        uint32_t last = UINT32_MAX;
+        for (int y = start; y < end && !too_many.load(std::memory_order_relaxed); y++) {
+            for (int x = 0; x < image.width; x++) {
+                uint32_t key = colour_key(image.pixels[y][x]);
+                if (key == last) continue;
+                last = key;
+                auto found = std::lower_bound(band.begin(), band.end(), key);
+                if (found != band.end() && *found == key) continue;
+                if ((int)band.size() == limit) {
+                    too_many = true;
+                    return;
+                }
+                band.insert(found, key);
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<uint32_t> merged;
+        std::set_union(colours.begin(), colours.end(), band.begin(), band.end(), std::back_inserter(merged));
+        if ((int)merged.size() > limit) {
+            too_many = true;
+        }
+        colours.swap(merged);
+    });
+    return !too_many;
+}
+
+void measure_box(const std::vector<Pixeldata>& samples, colour_box& box) {
+    int low[3] = {255, 255, 255};
+    int high[3] = {0, 0, 0};
+    for (int i = box.begin; i < box.end; i++) {
+        for (int c = 0; c < 3; c++) {
+            low[c] = std::min(low[c], channel_of(samples[i], c));
+            high[c] = std::max(high[c], channel_of(samples[i], c));
+        }
+    }
+    box.channel = 0;
+    for (int c = 1; c < 3; c++) {
+        if (high[c] - low[c] > high[box.channel] - low[box.channel]) box.channel = c;
+    }
+    box.range = high[box.channel] - low[box.channel];
+}
+
+// median cut over a sample, or the image's own colours when there are few enough
+void build_palette(const ImageDetails& image, int colours, std::vector<Pixeldata>& palette) {
+    palette.clear();
+    std::vector<uint32_t> keys;
+    if (find_colours(image, colours, keys)) {
+        for (uint32_t key : keys) {
+            Pixeldata colour;
+            colour.R = key >> 16;
+            colour.G = key >> 8;
+            colour.B = key;
+            palette.push_back(colour);
+        }
+        return;
+    }
+
+    // an even spread of samples, jittered so they don't line up in columns
+    long long total = (long long)image.width * image.height;
+    long long step = std::max(1LL, total / QUANTISE_SAMPLES);
+    std::vector<Pixeldata> samples;
+    samples.reserve(total / step + 1);
+    for (long long k = 0; k * step < total; k++) {
+        long long i = std::min(total - 1, k * step + (k * 40503) % step);
+        samples.push_back(image.pixels[i / image.width][i % image.width]);
+    }
+
+    // split the box with the most samples times spread until there are enough
+    std::vector<colour_box> boxes(1, colour_box{0, (int)samples.size(), 0, 0});
+    measure_box(samples, boxes[0]);
+    while ((int)boxes.size() < colours) {
+        int widest = -1;
+        long long widest_score = 0;
+        for (int i = 0; i < (int)boxes.size(); i++) {
+            long long score = (long long)boxes[i].range * (boxes[i].end - boxes[i].begin);
+            if (score > widest_score) {
+                widest = i;
+                widest_score = score;
+            }
+        }
+        if (widest < 0) break;
+
+        colour_box box = boxes[widest];
+        auto begin = samples.begin() + box.begin;
+        auto end = samples.begin() + box.end;
+        auto below = [&](const Pixeldata& a, const Pixeldata& b) {
+            return channel_of(a, box.channel) < channel_of(b, box.channel);
+        };
+        std::sort(begin, end, below);
+        // cut at the median, moved to the nearest change of value so equal colours stay together
+        auto middle = begin + (end - begin) / 2;
+        auto lower = std::lower_bound(begin, end, *middle, below);
+        auto upper = std::upper_bound(begin, end, *middle, below);
+        auto cut = (lower == begin || (upper != end && upper - middle < middle - lower)) ? upper : lower;
+
+        colour_box second{(int)(cut - samples.begin()), box.end, 0, 0};
+        boxes[widest].end = second.begin;
+        measure_box(samples, boxes[widest]);
+        measure_box(samples, second);
+        boxes.push_back(second);
+    }
+
+    // each box's mean colour
+    for (const colour_box& box : boxes) {
+        long long sum[3] = {0, 0, 0};
+        for (int i = box.begin; i < box.end; i++) {
+            for (int c = 0; c < 3; c++) sum[c] += channel_of(samples[i], c);
+        }
+        long long count = box.end - box.begin;
+        Pixeldata colour;
+        colour.B = (sum[0] + count / 2) / count;
+        colour.G = (sum[1] + count / 2) / count;
+        colour.R = (sum[2] + count / 2) / count;
+        palette.push_back(colour);
+    }
+}
+
+inline int distance(const Pixeldata& colour, int r, int g, int b) {
+    return (colour.R - r) * (colour.R - r) + (colour.G - g) * (colour.G - g) + (colour.B - b) * (colour.B - b);
+}
+
+// the entries that could be nearest to some colour in each cell: any entry closer to the cell's
+// nearest point than the best entry's farthest point
+void build_lookup(const std::vector<Pixeldata>& palette, palette_lookup& lookup) {
+    const int cell_size = 256 >> QUANTISE_CELL_BITS;
+    const int cells_per_channel = 1 << QUANTISE_CELL_BITS;
+    std::vector<std::vector<BYTE>> plane_candidates(cells_per_channel);
+    std::vector<int> counts(QUANTISE_CELLS);
+
+    parallel_for(0, cells_per_channel, 1, [&](int start, int end) {
+        std::vector<int> near_distance(palette.size());
+        for (int r = start; r < end; r++) {
+            for (int g = 0; g < cells_per_channel; g++) {
+                for (int b = 0; b < cells_per_channel; b++) {
+                    int low[3] = {r * cell_size, g * cell_size, b * cell_size};
+                    int best_far = INT32_MAX;
+                    for (size_t i = 0; i < palette.size(); i++) {
+                        int value[3] = {palette[i].R, palette[i].G, palette[i].B};
+                        int near = 0, far = 0;
+                        for (int c = 0; c < 3; c++) {
+                            int high = low[c] + cell_size - 1;
+                            int outside = value[c] < low[c] ? low[c] - value[c] : (value[c] > high ? value[c] - high : 0);
+                            int farthest = std::max(abs(value[c] - low[c]), abs(value[c] - high));
+                            near += outside * outside;
+                            far += farthest * farthest;
+                        }
+                        near_distance[i] = near;
+                        best_far = std::min(best_far, far);
+                    }
+                    int cell = (r << (2 * QUANTISE_CELL_BITS)) | (g << QUANTISE_CELL_BITS) | b;
+                    for (size_t i = 0; i < palette.size(); i++) {
+                        if (near_distance[i] <= best_far) {
+                            plane_candidates[r].push_back(i);
+                            counts[cell]++;
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    lookup.start.assign(QUANTISE_CELLS + 1, 0);
+    for (int cell = 0; cell < QUANTISE_CELLS; cell++) {
+        lookup.start[cell + 1] = lookup.start[cell] + counts[cell];
+    }
+    lookup.candidates.clear();
+    lookup.candidates.reserve(lookup.start[QUANTISE_CELLS]);
+    for (const std::vector<BYTE>& plane : plane_candidates) {
+        lookup.candidates.insert(lookup.candidates.end(), plane.begin(), plane.end());
+    }
+}
+
+void map_to_palette(ImageDetails& image, const std::vector<Pixeldata>& palette, bool dither) {
+    // the table costs about as much as searching the whole palette for every cell's worth of pixels
+    palette_lookup lookup;
+    bool use_lookup = palette.size() > 8 && (long long)image.width * image.height > 4LL * QUANTISE_CELLS;
+    if (use_lookup) {
+        build_lookup(palette, lookup);
+    }
+
+    // dither offsets spread over about one step between palette levels
+    int offsets[8][8];
+    float spread = 256.0f / cbrtf((float)palette.size());
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            offsets[y][x] = dither ? (int)lroundf((BAYER[y][x] - 31.5f) * spread / 64) : 0;
+        }
+    }
+
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            uint32_t last_key = UINT32_MAX;
+            Pixeldata last_colour = {0, 0, 0};
+            for (int x = 0; x < image.width; x++) {
+                Pixeldata& pixel = image.pixels[y][x];
+                uint32_t key = colour_key(pixel);
+                if (!dither && key == last_key) {
+                    pixel = last_colour;
+                    continue;
+                }
+                int offset = offsets[y & 7][x & 7];
+                int r = std::clamp(pixel.R + offset, 0, 255);
+                int g = std::clamp(pixel.G + offset, 0, 255);
+                int b = std::clamp(pixel.B + offset, 0, 255);
+
+                const BYTE* first = NULL;
+                const BYTE* last = NULL;
+                if (use_lookup) {
+                    int shift = 8 - QUANTISE_CELL_BITS;
+                    int cell = ((r >> shift) << (2 * QUANTISE_CELL_BITS)) | ((g >> shift) << QUANTISE_CELL_BITS) | (b >> shift);
+                    first = lookup.candidates.data() + lookup.start[cell];
+                    last = lookup.candidates.data() + lookup.start[cell + 1];
+                }
+                int best = 0;
+                int best_distance = INT32_MAX;
+                if (use_lookup) {
+                    for (const BYTE* candidate = first; candidate != last; candidate++) {
+                        int d = distance(palette[*candidate], r, g, b);
+                        if (d < best_distance) {
+                            best = *candidate;
+                            best_distance = d;
+                        }
+                    }
+                } else {
+                    for (size_t i = 0; i < palette.size(); i++) {
+                        int d = distance(palette[i], r, g, b);
+                        if (d < best_distance) {
+                            best = i;
+                            best_distance = d;
+                        }
+                    }
+                }
+                last_key = key;
+                last_colour = palette[best];
+                pixel = last_colour;
+            }
+        }
+    });
+}
+
+void applyQuantise(ImageDetails& image, int colours, bool dither) {
+    if (image.width <= 0 || image.height <= 0) {
+        return;
+    }
+    colours = std::clamp(colours, 2, 256);
+    // an image that already fits in the palette only changes when dithered
+    std::vector<uint32_t> keys;
+    if (!dither && find_colours(image, colours, keys)) {
+        return;
+    }
+    std::vector<Pixeldata> palette;
+    build_palette(image, colours, palette);
+    map_to_palette(image, palette, dither);
+}
+
+// decode an 8 bit palettised bmp into 24 bit pixels, with the headers of the 24 bit version
+int read_palette_bmp_buffer(const BYTE* data, size_t size, ImageDetails& image, BitmapFileHeader& file_header, BitmapInfoHeader& info_header) {
+    size_t header_size = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+    if (data == NULL || size < header_size) {
+        return 2;
+    }
+    memcpy(&file_header, data, sizeof(BitmapFileHeader));
+    memcpy(&info_header, data + sizeof(BitmapFileHeader), sizeof(BitmapInfoHeader));
+    if (file_header.bfType != 0x4D42 || info_header.biBitCount != 8 || info_header.biCompression != 0 || info_header.biWidth <= 0
+        || info_header.biClrUsed > 256 || info_header.biSize < sizeof(BitmapInfoHeader)) {
+        return 2;
+    }
+
+    // the palette follows the info header, 4 bytes per colour, unused entries are black
+    int colours = info_header.biClrUsed == 0 ? 256 : info_header.biClrUsed;
+    size_t palette_offset = sizeof(BitmapFileHeader) + info_header.biSize;
+    if (palette_offset + 4 * (size_t)colours > size) {
+        return 2;
+    }
+    Pixeldata palette[256] = {};
+    for (int i = 0; i < colours; i++) {
+        memcpy(&palette[i], data + palette_offset + 4 * i, 3);
+    }
+
+    int width = info_header.biWidth;
+    int height = abs(info_header.biHeight);
+    size_t row_size = ((size_t)width + 3) & ~(size_t)3;
+    if (file_header.bfOffBits + row_size * height > size) {
+        return 2;
+    }
+    if (create_image(image, width, height) != 0) {
+        return 3;
+    }
+    const BYTE* indices = data + file_header.bfOffBits;
+    parallel_for(0, height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            const BYTE* row = indices + row_size * y;
+            for (int x = 0; x < width; x++) {
+                image.pixels[y][x] = palette[row[x]];
+            }
+        }
+    });
+
+    // keep the row order and resolution, the rest describes the 24 bit pixels now in memory
+    LONG stored_height = info_header.biHeight;
+    LONG x_resolution = info_header.biXPelsPerMeter;
+    LONG y_resolution = info_header.biYPelsPerMeter;
+    make_bmp_headers(image, file_header, info_header);
+    info_header.biHeight = stored_height;
+    info_header.biXPelsPerMeter = x_resolution;
+    info_header.biYPelsPerMeter = y_resolution;
+    return 0;
+}
+
+// encode as an 8 bit palettised bmp, 1 when the image has more than 256 colours
+int encode_palette_bmp_buffer(const ImageDetails& image, const BitmapInfoHeader& info_header, std::vector<BYTE>& data) {
+    std::vector<uint32_t> colours;
+    if (!find_colours(image, 256, colours) || colours.empty()) {
+        return 1;
+    }
+
+    size_t header_size = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+    size_t palette_size = 4 * colours.size();
+    size_t row_size = ((size_t)image.width + 3) & ~(size_t)3;
+
+    BitmapFileHeader out_file_header;
+    memset(&out_file_header, 0, sizeof(out_file_header));
+    out_file_header.bfType = 0x4D42;
+    out_file_header.bfOffBits = header_size + palette_size;
+    out_file_header.bfSize = out_file_header.bfOffBits + row_size * image.height;
+
+    BitmapInfoHeader out_info_header = info_header;
+    out_info_header.biSize = sizeof(BitmapInfoHeader);
+    out_info_header.biWidth = image.width;
+    out_info_header.biPlanes = 1;
+    out_info_header.biBitCount = 8;
+    out_info_header.biCompression = 0;
+    out_info_header.biSizeImage = row_size * image.height;
+    out_info_header.biClrUsed = colours.size();
+    out_info_header.biClrImportant = 0;
+
+    data.assign(out_file_header.bfSize, 0);
+    memcpy(data.data(), &out_file_header, sizeof(BitmapFileHeader));
+    memcpy(data.data() + sizeof(BitmapFileHeader), &out_info_header, sizeof(BitmapInfoHeader));
+    BYTE* palette = data.data() + header_size;
+    for (size_t i = 0; i < colours.size(); i++) {
+        palette[4 * i] = colours[i];
+        palette[4 * i + 1] = colours[i] >> 8;
+        palette[4 * i + 2] = colours[i] >> 16;
+    }
+
+    // the colours are sorted, so each pixel's index is a binary search
+    BYTE* indices = data.data() + out_file_header.bfOffBits;
+    parallel_for(0, image.height, 0, [&](int start, int end) {
+        for (int y = start; y < end; y++) {
+            BYTE* row = indices + row_size * y;
+            uint32_t last_key = UINT32_MAX;
+            BYTE last_index = 0;
+            for (int x = 0; x < image.width; x++) {
+                uint32_t key = colour_key(image.pixels[y][x]);
+                if (key != last_key) {
+                    last_key = key;
+                    last_index = std::lower_bound(colours.begin(), colours.end(), key) - colours.begin();
+                }
+                row[x] = last_index;
+            }
+        }
+    });
+    return 0;
+}
@@ -0,0 +1,236 @@
+// filter_registry.cpp - the filters the library knows about
+// Each entry says what kind of access pattern the filter has, how far it reaches, what it costs and
+// how to run it, so the batch, in-place and passthrough paths can pick how to run any filter.
+
+// libaries
+#include "filter_lib.h"
+
+// halo functions
+int no_halo(int strength) {
+    return 0;
+}
+
+int one_pixel_halo(int strength) {
+    return 1;
+}
+
+int blur_halo(int strength) {
+    // each pass of the 3x3 kernel reaches one pixel further
+    return strength;
+}
+
+int noise_reduction_halo(int strength) {
+    return noise_reduction_offset(strength);
+}
+
+// cost functions, roughly the work per pixel relative to grayscale
+float no_cost(int strength) {
+    return 0.0f;
+}
+
+float grayscale_cost(int strength) {
+    return 1.0f;
+}
+
+float sepia_cost(int strength) {
+    return 3.0f;
+}
+
+float blur_cost(int strength) {
+    return 10.0f * strength;
+}
+
+float sharpen_cost(int strength) {
+    return 25.0f;
+}
+
+float edge_detection_cost(int strength) {
+    return 30.0f;
+}
+
+float noise_reduction_cost(int strength) {
+    // three sorts of the kernel's worth of samples
+    float samples = 2 * noise_reduction_halo(strength) + 1;
+    samples *= samples;
+    return 3.0f * samples * samples / 2;
+}
+
+float adaptive_median_cost(int strength) {
+    // the 3x3 test on every pixel, and a median for the few percent that look like noise
+    float samples = 2 * noise_reduction_halo(strength) + 1;
+    samples *= samples;
+    return 6.0f + samples / 10;
+}
+
+float wide_blur_cost(int strength) {
+    // a pass down to the reduced image and one back up, the exact tier is far more
+    return 8.0f;
+}
+
+float clarity_cost(int strength) {
+    // reducing and expanding a third more than the image, 5 taps each way
+    return 12.0f;
+}
+
+float overlay_cost(int strength) {
+    // only the overlay's box, about the square of its share of the width
+    return strength * strength / 10000.0f;
+}
+
+float ascii_cost(int strength) {
+    return 2.0f;
+}
+
+float temporal_median_cost(int strength) {
+    // an insertion sort of the window's samples per channel
+    float frames = std::min(strength + 1, TEMPORAL_MAX_FRAMES);
+    return frames * frames / 2;
+}
+
+float temporal_average_cost(int strength) {
+    return std::min(strength + 1, TEMPORAL_MAX_FRAMES);
+}
+
+float quantise_cost(int strength) {
+    // a few candidate distances per pixel, the palette is built from a sample
+    return 4.0f;
+}
+
+// adapters from the registry signature to the filters
+void run_grayscale(ImageDetails& image, const filter_params& params) {
+    applyGrayscale(image);
+}
+
+void run_grayscale_row(Pixeldata* row, int width, const filter_params& params) {
+    grayscale_row(row, width);
+}
+
+void run_sepia(ImageDetails& image, const filter_params& params) {
+    applySepia(image, params.strength, params.quality);
+}
+
+void run_sepia_row(Pixeldata* row, int width, const filter_params& params) {
+    sepia_row(row, width, mix_weight(params.strength), params.quality);
+}
+
+void run_flip(ImageDetails& image, const filter_params& params) {
+    applyFlip(image);
+}
+
+void run_flip_row(Pixeldata* row, int width, const filter_params& params) {
+    flip_row(row, width);
+}
+
+void run_gaussian_blur(ImageDetails& image, const filter_params& params) {
+    for (int i = 0; i < params.strength && !filter_cancelled(); i++) {
+        blur_pass(image, params.quality, params.algorithm);
+    }
+}
+
+void run_sharpen(ImageDetails& image, const filter_params& params) {
+    applySharpen(image, params.strength, params.quality);
+}
+
+void run_edge_detection(ImageDetails& image, const filter_params& params) {
+    applyEdgeDetection(image, params.quality);
+}
+
+void run_noise_reduction(ImageDetails& image, const filter_params& params) {
+    applyNoiseReduction(image, params.strength, params.quality, params.algorithm);
+}
+
+void run_adaptive_median(ImageDetails& image, const filter_params& params) {
+    applyAdaptiveMedian(image, params.strength);
+}
+
+void run_wide_blur(ImageDetails& image, const filter_params& params) {
+    applyWideBlur(image, params.strength, params.quality);
+}
+
+void run_clarity(ImageDetails& image, const filter_params& params) {
+    applyClarity(image, params.strength);
+}
+
+void run_overlay(ImageDetails& image, const filter_params& params) {
+    if (params.overlay != NULL) {
+        applyOverlay(image, *params.overlay, params.strength, params.top_down);
+    }
+}
+
+void run_no_filter(ImageDetails& image, const filter_params& params) {
+}
+
+void run_vertical_flip(ImageDetails& image, const filter_params& params) {
+    applyVerticalFlip(image);
+}
+
+void run_temporal_median(ImageDetails& frame, const std::vector<ImageDetails>& frames, int count, const filter_params& params) {
+    applyTemporalMedian(frame, frames, count);
+}
+
+void run_temporal_average(ImageDetails& frame, const std::vector<ImageDetails>& frames, int count, const filter_params& params) {
+    applyTemporalAverage(frame, frames, count);
+}
+
+void run_quantise(ImageDetails& image, const filter_params& params) {
+    applyQuantise(image, quantise_colours(params.strength), false);
+}
+
+void run_quantise_dither(ImageDetails& image, const filter_params& params) {
+    applyQuantise(image, quantise_colours(params.strength), true);
+}
+
+void vertical_flip_header(BitmapInfoHeader& info_header) {
+    // a negative height stores the rows top down, which flips the image vertically
+    info_header.biHeight = -info_header.biHeight;
+}
+
+// the built in filters, in menu order
+std::vector<filter_info>& filter_registry() {
+    static std::vector<filter_info> registry = {
+        // name               params kind                halo                  cost                   in_place channels palette apply                row                header                frames
+        {"No Filter",         false, FILTER_HEADER_ONLY, no_halo,              no_cost,               false,   3,       false,   run_no_filter,       NULL,              NULL,                 NULL},
+        {"Grayscale",         false, FILTER_POINT,       no_halo,              grayscale_cost,        true,    1,       false,   run_grayscale,       run_grayscale_row, NULL,                 NULL},
+        {"Sepia",             true,  FILTER_POINT,       no_halo,              sepia_cost,            true,    3,       false,   run_sepia,           run_sepia_row,     NULL,                 NULL},
+        {"Flip",              false, FILTER_ROW,         no_halo,              grayscale_cost,        true,    3,       false,   run_flip,            run_flip_row,      NULL,                 NULL},
+        {"Gaussian Blur",     true,  FILTER_STENCIL,     blur_halo,            blur_cost,             false,   3,       false,   run_gaussian_blur,   NULL,              NULL,                 NULL},
+        {"Sharpen",           true,  FILTER_STENCIL,     one_pixel_halo,       sharpen_cost,          false,   3,       false,   run_sharpen,         NULL,              NULL,                 NULL},
+        {"Edge Detection",    false, FILTER_STENCIL,     one_pixel_halo,       edge_detection_cost,   false,   1,       false,   run_edge_detection,  NULL,              NULL,                 NULL},
+        {"Noise Reduction",   true,  FILTER_STENCIL,     noise_reduction_halo, noise_reduction_cost,  false,   3,       false,   run_noise_reduction, NULL,              NULL,                 NULL},
+        // ascii makes text rather than an image so only the program runs it
+        {"ASCII",             false, FILTER_GLOBAL,      no_halo,              ascii_cost,            false,   1,       false,   NULL,                NULL,              NULL,                 NULL},
+        {"Vertical Flip",     false, FILTER_HEADER_ONLY, no_halo,              no_cost,               false,   3,       false,   run_vertical_flip,   NULL,              vertical_flip_header, NULL},
+        // temporal filters need the frames before, so they only run in sequence mode
+        {"Temporal Median",   true,  FILTER_TEMPORAL,    no_halo,              temporal_median_cost,  false,   3,       false,   NULL,                NULL,              NULL,                 run_temporal_median},
+        {"Temporal Average",  true,  FILTER_TEMPORAL,    no_halo,              temporal_average_cost, false,   3,       false,   NULL,                NULL,              NULL,                 run_temporal_average},
+        // saved as 8 bit palettised bmps
+        {"Quantise",          true,  FILTER_GLOBAL,      no_halo,              quantise_cost,         false,   3,       true,    run_quantise,        NULL,              NULL,                 NULL},
+        {"Quantise Dithered", true,  FILTER_GLOBAL,      no_halo,              quantise_cost,         false,   3,       true,    run_quantise_dither, NULL,              NULL,                 NULL},
+        {"Adaptive Median",   true,  FILTER_STENCIL,     noise_reduction_halo, adaptive_median_cost,  false,   3,       false,   run_adaptive_median, NULL,              NULL,                 NULL},
+        // the reduced image's blocks line up with the whole image, so it can't run on parts of one
+        {"Wide Blur",         true,  FILTER_GLOBAL,      no_halo,              wide_blur_cost,        false,   3,       false,   run_wide_blur,       NULL,              NULL,                 NULL},
+        {"Clarity",           true,  FILTER_GLOBAL,      no_halo,              clarity_cost,          false,   3,       false,   run_clarity,         NULL,              NULL,                 NULL},
+        // placed by where it is in the whole image, the image given with --overlay
+        {"Overlay",           true,  FILTER_GLOBAL,      no_halo,              overlay_cost,          false,   3,       false,   run_overlay,         NULL,              NULL,                 NULL}
+    };
+    return registry;
+}
+
+int filter_count() {
+    return filter_registry().size();
+}
+
+// NULL for an unknown id
+const filter_info* find_filter(int filter_id) {
+    std::vector<filter_info>& registry = filter_registry();
+    if (filter_id < 0 || filter_id >= (int)registry.size()) {
+        return NULL;
+    }
+    return &registry[filter_id];
+}
+
+// add a filter and return its id, call before any filtering starts
+int register_filter(const filter_info& info) {
+    filter_registry().push_back(info);
+    return filter_registry().size() - 1;
+}
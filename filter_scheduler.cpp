@@ -0,0 +1,446 @@
+// filter_scheduler.cpp - work stealing task scheduler
+// Every worker owns a deque of tasks, pushing and popping at the back while idle workers steal from
+// the front of the others. Threads waiting on a task group run tasks too, so filters parallelising
+// their rows inside a batch that parallelises over images balance without extra threads.
+// Spawned jobs (async jobs resuming, see filter_async.h) sit in a separate queue that only idle
+// threads take from, so a thread helping inside a wait never picks up a whole new job.
+// Tasks are queued by priority class. A thread takes from the class that has used the least cpu
+// against its share, so higher classes get in at the next band of rows while lower ones still
+// progress, and a thread waiting on a group only helps with work at least as urgent as its own.
+
+// libaries
+#include "filter_lib.h"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <stdlib.h>
+#include <sstream>
+#include <algorithm>
+#include <pthread.h>
+
+// a queued task and the group waiting on it
+struct scheduled_task {
+    task_function function;
+    task_group* group;
+};
+
+// one worker's deques, one per class, the last one belongs to threads outside the pool
+struct worker_queue {
+    std::mutex lock;
+    std::deque<scheduled_task> tasks[PRIORITY_CLASSES];
+};
+
+struct task_scheduler {
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex jobs_lock;
+    std::deque<task_function> jobs;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::atomic<int> queued{0};
+    std::atomic<bool> stop{false};
+    // per class: tasks waiting, and nanoseconds run scaled by 100 / share
+    std::atomic<int> class_queued[PRIORITY_CLASSES];
+    std::atomic<long long> class_time[PRIORITY_CLASSES];
+    std::atomic<int> shares[PRIORITY_CLASSES];
+
+    task_scheduler();
+    ~task_scheduler();
+};
+
+// which deque the current thread owns, -1 for threads outside the pool
+thread_local int worker_index = -1;
+
+// the cancel token of the filter this thread is working on
+thread_local const cancel_token* current_cancel = nullptr;
+
+// the class tasks submitted from this thread go in
+thread_local job_priority thread_priority = PRIORITY_NORMAL;
+
+// set while a whole image is being filtered on one thread
+thread_local bool run_serial = false;
+
+// time spent in tasks run inside the current task, so it isn't charged twice
+thread_local long long nested_time = 0;
+
+cancel_scope::cancel_scope(const cancel_token* token) {
+    previous = current_cancel;
+    current_cancel = token;
+}
+
+cancel_scope::~cancel_scope() {
+    current_cancel = previous;
+}
+
+priority_scope::priority_scope(job_priority priority) {
+    previous = thread_priority;
+    thread_priority = priority;
+}
+
+priority_scope::~priority_scope() {
+    thread_priority = previous;
+}
+
+serial_scope::serial_scope() {
+    previous = run_serial;
+    run_serial = true;
+}
+
+serial_scope::~serial_scope() {
+    run_serial = previous;
+}
+
+job_priority current_priority() {
+    return thread_priority;
+}
+
+void cancel_job(const cancel_token& token) {
+    token.cancelled = true;
+}
+
+void set_deadline(cancel_token& token, int milliseconds) {
+    token.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+}
+
+// true once the current filter has been cancelled or run past its deadline
+bool filter_cancelled() {
+    for (const cancel_token* token = current_cancel; token != nullptr; token = token->parent) {
+        if (token->cancelled.load(std::memory_order_relaxed)) return true;
+        if (token->deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= token->deadline) {
+            token->cancelled = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool pop_task(task_scheduler& scheduler, int index, int priority, scheduled_task& task) {
+    worker_queue& queue = *scheduler.queues[index];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks[priority].empty()) return false;
+    task = std::move(queue.tasks[priority].back());
+    queue.tasks[priority].pop_back();
+    return true;
+}
+
+bool steal_task(task_scheduler& scheduler, int thief, int priority, scheduled_task& task) {
+    int num_queues = scheduler.queues.size();
+    for (int i = 1; i <= num_queues; i++) {
+        worker_queue& queue = *scheduler.queues[(thief + i) % num_queues];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks[priority].empty()) {
+            task = std::move(queue.tasks[priority].front());
+            queue.tasks[priority].pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+// take the next task for this thread from classes up to lowest, the one furthest behind its share first
+// within a class its own newest first then the oldest of anyone else's
+bool find_task(task_scheduler& scheduler, scheduled_task& task, int lowest = PRIORITY_LOW) {
+    int order[PRIORITY_CLASSES];
+    int count = 0;
+    for (int priority = PRIORITY_HIGH; priority <= lowest; priority++) {
+        if (scheduler.class_queued[priority] > 0) {
+            order[count++] = priority;
+        }
+    }
+    std::stable_sort(order, order + count, [&](int a, int b) {
+        return scheduler.class_time[a] < scheduler.class_time[b];
+    });
+
+    int own = worker_index >= 0 ? worker_index : scheduler.queues.size() - 1;
+    for (int i = 0; i < count; i++) {
+        if (pop_task(scheduler, own, order[i], task) || steal_task(scheduler, own, order[i], task)) {
+            scheduler.class_queued[order[i]]--;
+            scheduler.queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+// whether any class up to lowest has a task waiting
+bool has_task(task_scheduler& scheduler, int lowest) {
+    for (int priority = PRIORITY_HIGH; priority <= lowest; priority++) {
+        if (scheduler.class_queued[priority] > 0) return true;
+    }
+    return false;
+}
+
+// wake every sleeping thread to look again at what it is waiting for
+// taking the lock first means a thread between checking and sleeping can't miss it
+void wake_all(task_scheduler& scheduler) {
+    {
+        std::lock_guard<std::mutex> guard(scheduler.sleep_lock);
+    }
+    scheduler.wake.notify_all();
+}
+
+bool pop_job(task_scheduler& scheduler, task_function& job) {
+    std::lock_guard<std::mutex> guard(scheduler.jobs_lock);
+    if (scheduler.jobs.empty()) return false;
+    job = std::move(scheduler.jobs.front());
+    scheduler.jobs.pop_front();
+    scheduler.queued--;
+    return true;
+}
+
+// run a task at its group's priority and charge its class for the time it took
+void run_task(task_scheduler& scheduler, scheduled_task& task) {
+    job_priority priority = task.group->priority;
+    long long outer_nested = nested_time;
+    nested_time = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        priority_scope scope(priority);
+        task.function();
+    }
+    long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    scheduler.class_time[priority] += (elapsed - nested_time) * 100 / scheduler.shares[priority];
+    nested_time = outer_nested + elapsed;
+    // the group may be gone as soon as it reaches 0, its waiter is woken through the scheduler
+    if (--task.group->pending == 0) {
+        wake_all(scheduler);
+    }
+}
+
+void worker_loop(task_scheduler& scheduler, int index) {
+    worker_index = index;
+    while (!scheduler.stop) {
+        scheduled_task task;
+        if (find_task(scheduler, task)) {
+            run_task(scheduler, task);
+            continue;
+        }
+        task_function job;
+        if (pop_job(scheduler, job)) {
+            job();
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(scheduler.sleep_lock);
+        scheduler.wake.wait(guard, [&]() { return scheduler.stop || scheduler.queued > 0; });
+    }
+}
+
+task_scheduler::task_scheduler() {
+    // the thread waiting on a group works as well, so one less than the core count
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    const char* override_threads = getenv("FILTER_THREADS");
+    if (override_threads != NULL && atoi(override_threads) > 0) {
+        num_threads = atoi(override_threads);
+    }
+    int num_workers = num_threads - 1;
+
+    // FILTER_SHARES=high,normal,low overrides the default split
+    int default_shares[PRIORITY_CLASSES] = {70, 20, 10};
+    const char* override_shares = getenv("FILTER_SHARES");
+    if (override_shares != NULL) {
+        std::stringstream list(override_shares);
+        string share;
+        for (int priority = 0; priority < PRIORITY_CLASSES && std::getline(list, share, ','); priority++) {
+            if (atoi(share.c_str()) > 0) {
+                default_shares[priority] = atoi(share.c_str());
+            }
+        }
+    }
+    for (int priority = 0; priority < PRIORITY_CLASSES; priority++) {
+        class_queued[priority] = 0;
+        class_time[priority] = 0;
+        shares[priority] = default_shares[priority];
+    }
+
+    for (int i = 0; i <= num_workers; i++) {
+        queues.emplace_back(new worker_queue);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        threads.emplace_back(worker_loop, std::ref(*this), i);
+    }
+}
+
+task_scheduler::~task_scheduler() {
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// the running scheduler, started on first use
+std::atomic<task_scheduler*> active_scheduler{nullptr};
+std::mutex start_lock;
+
+// hold the start lock over a fork so the child never gets it locked
+void before_fork() {
+    start_lock.lock();
+}
+
+void after_fork_parent() {
+    start_lock.unlock();
+}
+
+// the pool's threads don't come across a fork, so the child leaves the parent's scheduler behind and starts its own
+void after_fork_child() {
+    active_scheduler = nullptr;
+    worker_index = -1;
+    start_lock.unlock();
+}
+
+// stops the scheduler's threads when the program exits
+struct scheduler_owner {
+    ~scheduler_owner() {
+        delete active_scheduler.exchange(nullptr);
+    }
+};
+
+task_scheduler& get_scheduler() {
+    task_scheduler* scheduler = active_scheduler.load(std::memory_order_acquire);
+    if (scheduler != nullptr) return *scheduler;
+
+    static scheduler_owner owner;
+    std::lock_guard<std::mutex> guard(start_lock);
+    static bool fork_handlers = pthread_atfork(before_fork, after_fork_parent, after_fork_child) == 0;
+    (void)fork_handlers;
+    if (active_scheduler == nullptr) {
+        active_scheduler = new task_scheduler;
+    }
+    return *active_scheduler;
+}
+
+// threads that can run tasks at once, including the one waiting
+int scheduler_threads() {
+    return get_scheduler().threads.size() + 1;
+}
+
+// how much of the cpu a class gets while other classes have work too, relative to the others' shares
+void scheduler_set_share(job_priority priority, int share) {
+    if (priority < 0 || priority >= PRIORITY_CLASSES || share <= 0) return;
+    get_scheduler().shares[priority] = share;
+}
+
+// a class that has been idle starts level with the busy ones rather than owed all the time it sat out
+void catch_up(task_scheduler& scheduler, int priority) {
+    long long busiest = -1;
+    for (int other = 0; other < PRIORITY_CLASSES; other++) {
+        if (other != priority && scheduler.class_queued[other] > 0 && (busiest < 0 || scheduler.class_time[other] < busiest)) {
+            busiest = scheduler.class_time[other];
+        }
+    }
+    if (busiest > scheduler.class_time[priority]) {
+        scheduler.class_time[priority] = busiest;
+    }
+}
+
+void scheduler_submit(task_group& group, task_function function) {
+    task_scheduler& scheduler = get_scheduler();
+    int own = worker_index >= 0 ? worker_index : scheduler.queues.size() - 1;
+    group.pending++;
+    {
+        worker_queue& queue = *scheduler.queues[own];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks[group.priority].push_back({std::move(function), &group});
+    }
+    if (scheduler.class_queued[group.priority]++ == 0) {
+        catch_up(scheduler, group.priority);
+    }
+    {
+        std::lock_guard<std::mutex> guard(scheduler.sleep_lock);
+        scheduler.queued++;
+    }
+    // all of them, a thread asleep in a wait may not take this class and would swallow a single wakeup
+    scheduler.wake.notify_all();
+}
+
+// run tasks, ours or stolen, until everything in the group has finished
+// only tasks at least as urgent as the group's are picked up, so a high priority wait isn't held up by a long low band
+void scheduler_wait(task_group& group) {
+    task_scheduler& scheduler = get_scheduler();
+    while (group.pending > 0) {
+        scheduled_task task;
+        if (find_task(scheduler, task, group.priority)) {
+            run_task(scheduler, task);
+            continue;
+        }
+        // sleep like an idle worker until the group finishes or there is something to help with
+        std::unique_lock<std::mutex> guard(scheduler.sleep_lock);
+        scheduler.wake.wait(guard, [&]() { return group.pending == 0 || has_task(scheduler, group.priority); });
+    }
+}
+
+// queue a job for the next idle thread, nothing waits on it
+// with no pool threads only a thread driving the scheduler would take it, so it runs right here
+void scheduler_spawn(task_function function) {
+    task_scheduler& scheduler = get_scheduler();
+    if (scheduler.threads.empty()) {
+        function();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(scheduler.jobs_lock);
+        scheduler.jobs.push_back(std::move(function));
+    }
+    {
+        std::lock_guard<std::mutex> guard(scheduler.sleep_lock);
+        scheduler.queued++;
+    }
+    scheduler.wake.notify_all();
+}
+
+// wake threads in scheduler_drive after whatever their done() checks has changed
+void scheduler_notify() {
+    wake_all(get_scheduler());
+}
+
+// run tasks and jobs on this thread until done() says to stop
+void scheduler_drive(const std::function<bool()>& done) {
+    task_scheduler& scheduler = get_scheduler();
+    while (!done()) {
+        scheduled_task task;
+        task_function job;
+        if (find_task(scheduler, task)) {
+            run_task(scheduler, task);
+        } else if (pop_job(scheduler, job)) {
+            job();
+        } else {
+            // done() changing is signalled with scheduler_notify
+            std::unique_lock<std::mutex> guard(scheduler.sleep_lock);
+            scheduler.wake.wait(guard, [&]() { return done() || scheduler.queued > 0; });
+        }
+    }
+}
+
+// split [begin, end) into chunks of grain and run body(chunk_begin, chunk_end) on each
+// chunks are skipped once the current filter is cancelled
+void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& body) {
+    if (end <= begin || filter_cancelled()) return;
+    if (grain <= 0) {
+        // a few chunks per thread so uneven chunks even out
+        grain = std::max(1, (end - begin) / (scheduler_threads() * 8));
+    }
+    if (end - begin <= grain || scheduler_threads() == 1 || run_serial) {
+        body(begin, end);
+        return;
+    }
+
+    // the bands are the points where work of a higher class can get in
+    task_group group;
+    group.priority = thread_priority;
+    for (int start = begin; start < end; start += grain) {
+        int stop = std::min(end, start + grain);
+        const cancel_token* token = current_cancel;
+        scheduler_submit(group, [&body, start, stop, token]() {
+            cancel_scope scope(token);
+            if (!filter_cancelled()) {
+                body(start, stop);
+            }
+        });
+    }
+    scheduler_wait(group);
+}
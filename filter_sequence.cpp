@@ -0,0 +1,301 @@
+// filter_sequence.cpp - frame sequence mode
+// Consecutive video frames are mostly the same, so the previous frame's input and output are kept
+// and each new frame is compared with the old input tile by tile. Tiles whose input changed, grown
+// by the filter's halo, are filtered again on a small image cut out with a halo margin around them.
+// Everything else is copied from the previous output.
+
+// libaries
+#include "filter_lib.h"
+#include "filter_internal.h"
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+
+// a run of dirty tiles next to each other in one row of tiles
+struct tile_span {
+    int tile_y;
+    int first_x;
+    int last_x;
+};
+
+// copy a width x height block of pixels from one image to another
+void copy_block(const ImageDetails& from, int from_x, int from_y, ImageDetails& to, int to_x, int to_y, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        memcpy(&to.pixels[to_y + y][to_x], &from.pixels[from_y + y][from_x], (size_t)width * sizeof(Pixeldata));
+    }
+}
+
+void free_frame_history(frame_history& history) {
+    if (history.valid) {
+        freeImage(history.input);
+        freeImage(history.output);
+    }
+    history.valid = false;
+}
+
+// filter the whole frame and keep its input and output for the next one
+int filter_whole_frame(frame_history& history, ImageDetails& frame, int filter_id, const filter_params& params) {
+    free_frame_history(history);
+    ImageDetails input;
+    input.width = frame.width;
+    input.height = frame.height;
+    input.pixels = copy_pixels(frame.pixels, frame.height, frame.width);
+
+    int result = apply_filter(frame, filter_id, params);
+    if (result != 0) {
+        freeImage(input);
+        return result;
+    }
+    history.input = input;
+    history.output.width = frame.width;
+    history.output.height = frame.height;
+    history.output.pixels = copy_pixels(frame.pixels, frame.height, frame.width);
+    history.valid = true;
+    return 0;
+}
+
+int filter_next_frame(frame_history& history, ImageDetails& frame, int filter_id, const filter_params& params) {
+    const filter_info* filter = find_filter(filter_id);
+    if (filter == NULL || filter->apply == NULL) {
+        return 1;
+    }
+    int tiles_x = (frame.width + SEQUENCE_TILE - 1) / SEQUENCE_TILE;
+    int tiles_y = (frame.height + SEQUENCE_TILE - 1) / SEQUENCE_TILE;
+    int num_tiles = tiles_x * tiles_y;
+    history.tiles_total += num_tiles;
+
+    // first frame, new size or a filter that reads the whole image
+    if (!history.valid || history.input.width != frame.width || history.input.height != frame.height || filter->kind == FILTER_GLOBAL) {
+        history.tiles_filtered += num_tiles;
+        return filter_whole_frame(history, frame, filter_id, params);
+    }
+
+    // find the tiles whose input changed, memcmp of each row is as fast as hashing and exact
+    std::vector<char> changed(num_tiles, 0);
+    parallel_for(0, tiles_y, 1, [&](int first, int last) {
+        for (int tile_y = first; tile_y < last; tile_y++) {
+            int y_end = std::min(frame.height, (tile_y + 1) * SEQUENCE_TILE);
+            for (int tile_x = 0; tile_x < tiles_x; tile_x++) {
+                int x = tile_x * SEQUENCE_TILE;
+                size_t bytes = (size_t)(std::min(frame.width, x + SEQUENCE_TILE) - x) * sizeof(Pixeldata);
+                for (int y = tile_y * SEQUENCE_TILE; y < y_end; y++) {
+                    if (memcmp(&frame.pixels[y][x], &history.input.pixels[y][x], bytes) != 0) {
+                        changed[tile_y * tiles_x + tile_x] = 1;
+                        break;
+                    }
+                }
+            }
+        }
+    });
+
+    // an output tile is dirty if any input it reads changed, row filters read the whole row
+    int halo = filter->halo(params.strength);
+    int reach = (halo + SEQUENCE_TILE - 1) / SEQUENCE_TILE;
+    int reach_x = filter->kind == FILTER_ROW ? tiles_x : reach;
+    std::vector<char> dirty(num_tiles, 0);
+    for (int tile_y = 0; tile_y < tiles_y; tile_y++) {
+        for (int tile_x = 0; tile_x < tiles_x; tile_x++) {
+            if (!changed[tile_y * tiles_x + tile_x]) continue;
+            for (int y = std::max(0, tile_y - reach); y <= std::min(tiles_y - 1, tile_y + reach); y++) {
+                for (int x = std::max(0, tile_x - reach_x); x <= std::min(tiles_x - 1, tile_x + reach_x); x++) {
+                    dirty[y * tiles_x + x] = 1;
+                }
+            }
+        }
+    }
+    int num_dirty = std::count(dirty.begin(), dirty.end(), 1);
+    history.tiles_filtered += num_dirty;
+
+    // past half the frame the halo margins cost more than filtering it all
+    if (num_dirty * 2 > num_tiles) {
+        return filter_whole_frame(history, frame, filter_id, params);
+    }
+
+    // filter runs of dirty tiles with a halo margin around them, one run per task
+    std::vector<tile_span> spans;
+    for (int tile_y = 0; tile_y < tiles_y; tile_y++) {
+        for (int tile_x = 0; tile_x < tiles_x; tile_x++) {
+            if (!dirty[tile_y * tiles_x + tile_x]) continue;
+            if (!spans.empty() && spans.back().tile_y == tile_y && spans.back().last_x == tile_x - 1) {
+                spans.back().last_x = tile_x;
+            } else {
+                spans.push_back({tile_y, tile_x, tile_x});
+            }
+        }
+    }
+    std::atomic<int> failed{0};
+    parallel_for(0, spans.size(), 1, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            const tile_span& span = spans[i];
+            int x0 = span.first_x * SEQUENCE_TILE;
+            int x1 = std::min(frame.width, (span.last_x + 1) * SEQUENCE_TILE);
+            int y0 = span.tile_y * SEQUENCE_TILE;
+            int y1 = std::min(frame.height, y0 + SEQUENCE_TILE);
+            int margin_x0 = filter->kind == FILTER_ROW ? 0 : std::max(0, x0 - halo);
+            int margin_x1 = filter->kind == FILTER_ROW ? frame.width : std::min(frame.width, x1 + halo);
+            int margin_y0 = std::max(0, y0 - halo);
+            int margin_y1 = std::min(frame.height, y1 + halo);
+
+            ImageDetails part;
+            create_image(part, margin_x1 - margin_x0, margin_y1 - margin_y0);
+            copy_block(frame, margin_x0, margin_y0, part, 0, 0, part.width, part.height);
+            int result;
+            {
+                // the runs are the parallelism, each is filtered on this thread
+                serial_scope serial;
+                result = apply_filter(part, filter_id, params);
+            }
+            if (result != 0) {
+                failed = result;
+            } else {
+                copy_block(part, x0 - margin_x0, y0 - margin_y0, history.output, x0, y0, x1 - x0, y1 - y0);
+            }
+            freeImage(part);
+        }
+    });
+    if (failed != 0) {
+        // the kept output is half updated now
+        free_frame_history(history);
+        return failed;
+    }
+
+    // remember the changed input and hand back the whole output
+    for (int tile_y = 0; tile_y < tiles_y; tile_y++) {
+        for (int tile_x = 0; tile_x < tiles_x; tile_x++) {
+            if (!changed[tile_y * tiles_x + tile_x]) continue;
+            int x = tile_x * SEQUENCE_TILE;
+            int y = tile_y * SEQUENCE_TILE;
+            copy_block(frame, x, y, history.input, x, y, std::min(frame.width, x + SEQUENCE_TILE) - x, std::min(frame.height, y + SEQUENCE_TILE) - y);
+        }
+    }
+    copy_block(history.output, 0, 0, frame, 0, 0, frame.width, frame.height);
+    return 0;
+}
+
+void free_temporal_window(temporal_window& window) {
+    for (ImageDetails& buffer : window.frames) {
+        freeImage(buffer);
+    }
+    window.frames.clear();
+    window.next = 0;
+    window.filled = 0;
+}
+
+// add the frame to the window of the last strength + 1 frames and run a temporal filter over it
+int filter_temporal_frame(temporal_window& window, ImageDetails& frame, int filter_id, const filter_params& params) {
+    const filter_info* filter = find_filter(filter_id);
+    if (filter == NULL || filter->apply_frames == NULL) {
+        return 1;
+    }
+    int size = std::clamp(params.strength + 1, 2, TEMPORAL_MAX_FRAMES);
+
+    // the buffers are allocated once and reused until the window or frame size changes
+    if ((int)window.frames.size() != size || window.frames[0].width != frame.width || window.frames[0].height != frame.height) {
+        free_temporal_window(window);
+        window.frames.resize(size);
+        for (ImageDetails& buffer : window.frames) {
+            create_image(buffer, frame.width, frame.height);
+        }
+    }
+    copy_block(frame, 0, 0, window.frames[window.next], 0, 0, frame.width, frame.height);
+    window.next = (window.next + 1) % size;
+    window.filled = std::min(window.filled + 1, size);
+
+    cancel_scope scope(params.cancel);
+    priority_scope priority(params.priority);
+    filter->apply_frames(frame, window.frames, window.filled, params);
+    return filter_cancelled() ? 2 : 0;
+}
+
+// the last number in a file name, frames are ordered by it
+long long frame_number(const string& path) {
+    string name = strip_extension(get_filename(path));
+    size_t end = name.find_last_of("0123456789");
+    if (end == string::npos) return -1;
+    size_t start = name.find_last_not_of("0123456789", end);
+    start = start == string::npos ? 0 : start + 1;
+    return std::stoll(name.substr(start, std::min<size_t>(end - start + 1, 18)));
+}
+
+void run_sequence_mode(program_states& states, const string& directory) {
+    const filter_info* filter = find_filter(states.selected_filter);
+    // nothing to carry between frames when the pixels aren't touched
+    if (filter->kind == FILTER_HEADER_ONLY) {
+        run_directory_mode(states, directory);
+        return;
+    }
+
+    // numbered frames
+    std::vector<string> paths;
+    list_directory_inputs(directory, filter, paths);
+    std::sort(paths.begin(), paths.end(), [](const string& a, const string& b) {
+        long long frame_a = frame_number(a);
+        long long frame_b = frame_number(b);
+        return frame_a != frame_b ? frame_a < frame_b : a < b;
+    });
+    if (paths.empty()) {
+        std::cerr << "Error: No BMP files found in " << directory << std::endl;
+        return;
+    }
+
+    frame_history history;
+    temporal_window window;
+    bool temporal = filter->kind == FILTER_TEMPORAL;
+    size_t written = 0;
+    priority_scope priority(states.priority);
+    for (const string& path : paths) {
+        io_request request;
+        request.path = path;
+        read_whole_file(request);
+        ImageDetails frame;
+        BitmapFileHeader file_header;
+        BitmapInfoHeader info_header;
+        if (request.result != 0 || read_bmp_buffer(request.data.data(), request.data.size(), frame, file_header, info_header) != 0) {
+            std::cerr << "Error: Invalid file " << path << std::endl;
+            continue;
+        }
+
+        cancel_token cancel;
+        if (states.timeout_ms > 0) {
+            set_deadline(cancel, states.timeout_ms);
+        }
+        filter_params params;
+        params.strength = states.filter_strength;
+        params.cancel = &cancel;
+        params.priority = states.priority;
+        params.quality = states.quality;
+        params.mix = states.mix;
+        params.overlay = states.overlay;
+        params.top_down = info_header.biHeight < 0;
+        int result = temporal ? filter_temporal_frame(window, frame, states.selected_filter, params)
+                              : filter_next_frame(history, frame, states.selected_filter, params);
+        if (result == 1) {
+            std::cerr << "Error: Could not filter " << path << ", memory ran out" << std::endl;
+        } else if (result == 2) {
+            std::cerr << "Error: Timed out filtering " << path << std::endl;
+        }
+        if (result != 0) {
+            freeImage(frame);
+            continue;
+        }
+
+        request.path = directory + "/" + strip_extension(get_filename(path)) + "_" + filter->name + ".bmp";
+        encode_filter_output(filter, frame, file_header, info_header, request.data);
+        freeImage(frame);
+        write_whole_file(request);
+        if (request.result != 0) {
+            std::cerr << "Error: Could not write output file " << request.path << ": " << strerror(-request.result) << std::endl;
+        } else {
+            written++;
+        }
+    }
+
+    int refiltered = history.tiles_total == 0 ? 0 : (int)(100 * history.tiles_filtered / history.tiles_total);
+    free_frame_history(history);
+    free_temporal_window(window);
+    std::cout << "Filtered " << written << " of " << paths.size() << " frames in " << directory;
+    if (!temporal) {
+        std::cout << ", " << refiltered << "% of tiles refiltered";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,372 @@
+// filter_workers.cpp - multi process worker pool
+// The supervisor forks worker processes and hands each one job at a time over a unix socket. The
+// opened input and output files are passed with the message, the worker maps the input and encodes
+// its result straight into the mapped output, so no image bytes are copied on the way. A worker
+// that crashes or hangs takes only its own job down, the supervisor kills it if needed, removes the
+// partial output and forks a replacement.
+
+// libaries
+#include "filter_lib.h"
+#include "filter_internal.h"
+#include <string.h>
+#include <errno.h>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+
+// sent to a worker along with the input bmp and the output file to write
+struct worker_request {
+    int filter_id;
+    int filter_strength;
+    int priority;
+    int quality;
+    int mix;
+    int timeout_ms;
+    size_t size;
+};
+
+// sent back once the output file is written, or not
+struct worker_reply {
+    int result;
+};
+
+// the most descriptors a message carries, a job's input and output
+const int MESSAGE_MAX_FDS = 2;
+
+// send a message and num_fds file descriptors with it
+bool send_message(int socket, const void* message, size_t size, const int* fds, int num_fds) {
+    iovec data = {const_cast<void*>(message), size};
+    msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = &data;
+    header.msg_iovlen = 1;
+
+    char control[CMSG_SPACE(sizeof(int) * MESSAGE_MAX_FDS)];
+    if (num_fds > 0) {
+        memset(control, 0, sizeof(control));
+        header.msg_control = control;
+        header.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+        cmsghdr* rights = CMSG_FIRSTHDR(&header);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+        memcpy(CMSG_DATA(rights), fds, sizeof(int) * num_fds);
+    }
+    // a dead worker gives EPIPE here rather than killing us with SIGPIPE
+    return sendmsg(socket, &header, MSG_NOSIGNAL) == (ssize_t)size;
+}
+
+// receive a message and up to num_fds descriptors sent with it (-1 for each one missing), false
+// once the other end has gone
+bool receive_message(int socket, void* message, size_t size, int* fds, int num_fds) {
+    iovec data = {message, size};
+    msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = &data;
+    header.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int) * MESSAGE_MAX_FDS)];
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    std::fill(fds, fds + num_fds, -1);
+    ssize_t got = recvmsg(socket, &header, MSG_CMSG_CLOEXEC);
+    cmsghdr* rights = got > 0 ? CMSG_FIRSTHDR(&header) : NULL;
+    if (rights != NULL && rights->cmsg_type == SCM_RIGHTS) {
+        int received = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < received; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(rights) + i * sizeof(int), sizeof(int));
+            if (i < num_fds) {
+                fds[i] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+    if (got != (ssize_t)size) {
+        for (int i = 0; i < num_fds; i++) {
+            if (fds[i] >= 0) close(fds[i]);
+            fds[i] = -1;
+        }
+        return false;
+    }
+    return true;
+}
+
+// filter one mapped bmp and encode the result straight into a mapping of the output file
+int filter_in_worker(const worker_request& request, const BYTE* data, const overlay_source* overlay, int out_fd) {
+    ImageDetails image;
+    BitmapFileHeader file_header;
+    BitmapInfoHeader info_header;
+    if (read_bmp_buffer(data, request.size, image, file_header, info_header) != 0) {
+        return 1;
+    }
+
+    cancel_token cancel;
+    if (request.timeout_ms > 0) {
+        set_deadline(cancel, request.timeout_ms);
+    }
+    filter_params params;
+    params.strength = request.filter_strength;
+    params.priority = (job_priority)request.priority;
+    params.quality = (filter_quality)request.quality;
+    params.mix = request.mix;
+    params.overlay = overlay;
+    params.top_down = info_header.biHeight < 0;
+    params.cancel = &cancel;
+    int result = apply_filter(image, request.filter_id, params);
+    if (result != 0) {
+        freeImage(image);
+        return result;
+    }
+
+    // a palettised size is only known once it is encoded, it is small enough to copy in
+    const filter_info* filter = find_filter(request.filter_id);
+    std::vector<BYTE> palettised;
+    bool palette = filter->palettised && encode_palette_bmp_buffer(image, info_header, palettised) == 0;
+    size_t size = palette ? palettised.size() : bmp_buffer_size(image);
+    void* output = ftruncate(out_fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0) : MAP_FAILED;
+    if (output == MAP_FAILED) {
+        freeImage(image);
+        return 1;
+    }
+    if (palette) {
+        memcpy(output, palettised.data(), size);
+    } else {
+        encode_bmp_into(image, file_header, info_header, static_cast<BYTE*>(output));
+    }
+    munmap(output, size);
+    freeImage(image);
+    return 0;
+}
+
+// the worker process, serves jobs until the supervisor closes its end
+void worker_main(int socket, const overlay_source* overlay) {
+    while (true) {
+        worker_request request;
+        int fds[2];
+        if (!receive_message(socket, &request, sizeof(request), fds, 2)) {
+            _exit(0);
+        }
+        int in_fd = fds[0];
+        int out_fd = fds[1];
+
+        worker_reply reply = {1};
+        void* mapped = in_fd < 0 || out_fd < 0 || request.size == 0 ? MAP_FAILED : mmap(NULL, request.size, PROT_READ, MAP_SHARED, in_fd, 0);
+        if (mapped != MAP_FAILED) {
+            try {
+                reply.result = filter_in_worker(request, static_cast<BYTE*>(mapped), overlay, out_fd);
+            } catch (const std::bad_alloc&) {
+                // a header claiming a huge image
+                reply.result = 1;
+            }
+            munmap(mapped, request.size);
+        }
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+
+        if (!send_message(socket, &reply, sizeof(reply), NULL, 0)) {
+            _exit(0);
+        }
+    }
+}
+
+// fork worker index of the pool, false if the process couldn't be made
+bool start_worker(worker_pool& pool, int index) {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sockets[0]);
+        close(sockets[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // die with the supervisor, and keep none of the other workers' sockets
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        close(sockets[0]);
+        for (const worker_process& other : pool.workers) {
+            if (other.socket >= 0) close(other.socket);
+        }
+        // each worker runs its own scheduler, split the cores between them unless told otherwise
+        if (getenv("FILTER_THREADS") == NULL) {
+            int threads = std::max(1u, std::thread::hardware_concurrency() / (unsigned)pool.workers.size());
+            setenv("FILTER_THREADS", std::to_string(threads).c_str(), 0);
+        }
+        worker_main(sockets[1], pool.overlay);
+    }
+    close(sockets[1]);
+    pool.workers[index].pid = pid;
+    pool.workers[index].socket = sockets[0];
+    return true;
+}
+
+// reap a worker that died or was killed and fork its replacement
+void restart_worker(worker_pool& pool, int index) {
+    worker_process& worker = pool.workers[index];
+    close(worker.socket);
+    worker.socket = -1;
+    int status;
+    waitpid(worker.pid, &status, 0);
+    worker.pid = -1;
+    if (!start_worker(pool, index)) {
+        std::cerr << "Error: Could not restart worker " << index << std::endl;
+    }
+}
+
+int start_worker_pool(worker_pool& pool, int num_workers, int job_timeout_ms, const overlay_source* overlay) {
+    pool.job_timeout_ms = job_timeout_ms;
+    pool.overlay = overlay;
+    pool.workers.assign(num_workers, worker_process{-1, -1});
+    for (int i = 0; i < num_workers; i++) {
+        if (!start_worker(pool, i)) {
+            std::cerr << "Error: Could not start worker processes" << std::endl;
+            stop_worker_pool(pool);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void stop_worker_pool(worker_pool& pool) {
+    // closing the socket tells a worker to exit
+    for (worker_process& worker : pool.workers) {
+        if (worker.socket >= 0) close(worker.socket);
+    }
+    for (worker_process& worker : pool.workers) {
+        if (worker.pid > 0) {
+            int status;
+            waitpid(worker.pid, &status, 0);
+        }
+    }
+    pool.workers.clear();
+}
+
+// send the opened input and output files, 1 if either can't be opened, 2 if the worker is gone
+int send_job(worker_process& worker, const worker_job& job, int timeout_ms) {
+    int in_fd = open(job.in_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (in_fd < 0 || fstat(in_fd, &info) != 0) {
+        if (in_fd >= 0) close(in_fd);
+        return 1;
+    }
+    // read and write, the worker maps it to encode into
+    int out_fd = open(job.out_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out_fd < 0) {
+        close(in_fd);
+        return 1;
+    }
+
+    worker_request request = {job.filter_id, job.filter_strength, job.priority, job.quality, job.mix, timeout_ms, (size_t)info.st_size};
+    int fds[2] = {in_fd, out_fd};
+    bool sent = send_message(worker.socket, &request, sizeof(request), fds, 2);
+    close(in_fd);
+    close(out_fd);
+    return sent ? 0 : 2;
+}
+
+void run_worker_jobs(worker_pool& pool, std::vector<worker_job>& jobs) {
+    int num_workers = pool.workers.size();
+    // the job each worker is on (-1 when idle) and when to give up on it
+    std::vector<int> running(num_workers, -1);
+    std::vector<std::chrono::steady_clock::time_point> kill_at(num_workers);
+    size_t next = 0;
+    size_t finished = 0;
+
+    while (finished < jobs.size()) {
+        // hand out jobs to idle workers
+        bool any_alive = false;
+        for (int i = 0; i < num_workers; i++) {
+            if (pool.workers[i].pid < 0) continue;
+            any_alive = true;
+            while (running[i] < 0 && next < jobs.size()) {
+                worker_job& job = jobs[next];
+                // the worker stops itself at the deadline, it is only killed if it doesn't
+                int timeout_ms = job.timeout_ms > 0 ? job.timeout_ms : pool.job_timeout_ms;
+                int sent = send_job(pool.workers[i], job, timeout_ms);
+                if (sent == 2) {
+                    // opened again when the job is resent
+                    unlink(job.out_path.c_str());
+                    restart_worker(pool, i);
+                    break;
+                }
+                if (sent == 1) {
+                    job.result = 1;
+                    unlink(job.out_path.c_str());
+                    finished++;
+                } else {
+                    running[i] = next;
+                    // without a timeout the watchdog still catches a worker stuck for good
+                    kill_at[i] = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms > 0 ? timeout_ms + 1000 : WORKER_WATCHDOG_MS);
+                }
+                next++;
+            }
+        }
+        if (!any_alive) {
+            // nothing left to run them on
+            for (; next < jobs.size(); next++, finished++) {
+                jobs[next].result = 3;
+            }
+            if (finished >= jobs.size()) break;
+        }
+
+        // wait for a reply, a worker dying or the next kill deadline
+        std::vector<pollfd> polls;
+        std::vector<int> polled;
+        auto now = std::chrono::steady_clock::now();
+        int wait_ms = -1;
+        for (int i = 0; i < num_workers; i++) {
+            if (running[i] < 0) continue;
+            polls.push_back({pool.workers[i].socket, POLLIN, 0});
+            polled.push_back(i);
+            int left = std::max<long long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(kill_at[i] - now).count());
+            wait_ms = wait_ms < 0 ? left : std::min(wait_ms, left);
+        }
+        if (polls.empty()) continue;
+        if (poll(polls.data(), polls.size(), wait_ms) < 0 && errno != EINTR) {
+            std::cerr << "Error: Could not wait on worker processes" << std::endl;
+            return;
+        }
+
+        now = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < polls.size(); p++) {
+            int i = polled[p];
+            worker_job& job = jobs[running[i]];
+            if (polls[p].revents != 0) {
+                worker_reply reply;
+                if (receive_message(pool.workers[i].socket, &reply, sizeof(reply), NULL, 0)) {
+                    job.result = reply.result;
+                } else {
+                    std::cerr << "Error: Worker crashed on " << job.in_path << ", restarting it" << std::endl;
+                    job.result = 3;
+                    restart_worker(pool, i);
+                }
+            } else if (now >= kill_at[i]) {
+                std::cerr << "Error: Worker hung on " << job.in_path << ", restarting it" << std::endl;
+                kill(pool.workers[i].pid, SIGKILL);
+                job.result = 2;
+                restart_worker(pool, i);
+            } else {
+                continue;
+            }
+            // the output was opened for the worker, nothing or part of an image is in it
+            if (job.result != 0) {
+                unlink(job.out_path.c_str());
+            }
+            running[i] = -1;
+            finished++;
+        }
+    }
+}